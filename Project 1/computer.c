@@ -1,128 +1,1411 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
 #include "computer.h"
+#include "cfg.h"
+#include "events.h"
+#include "debug.h"
+#include "loader.h"
+#include "counters.h"
 #undef mips			/* gcc already has a def for mips */
 
+#define TRUE 1
+#define FALSE 0
+
 unsigned int endianSwap(unsigned int);
 
-void PrintInfo (int changedReg, int changedMem);
-unsigned int Fetch (int);
-void Decode (unsigned int, DecodedInstr*, RegVals*);
-int Execute (DecodedInstr*, RegVals*);
-int Mem(DecodedInstr*, int, int *);
-void RegWrite(DecodedInstr*, int, int *);
-void UpdatePC(DecodedInstr*, int);
-void PrintInstruction (DecodedInstr*);
+void PrintInfo (int changedReg, int changedMem);
+unsigned int Fetch (int);
+void Decode (unsigned int, DecodedInstr*, RegVals*);
+int Execute (DecodedInstr*, RegVals*);
+int Mem(DecodedInstr*, int, int *);
+void RegWrite(DecodedInstr*, int, int *);
+void UpdatePC(DecodedInstr*, int);
+void PrintInstruction (DecodedInstr*);
+
+/*
+ *  Globally accessible Computer variable. Each hart runs on its own
+ *  thread and has its own copy; they all share guestMemory.
+ */
+__thread Computer mips;
+__thread RegVals rVals;
+
+/*
+ *  Guest memory has a host mapping of its own, page aligned, so that
+ *  the debugger can write-protect the host pages under a watched range.
+ */
+#define GUESTWORDS (MAXNUMINSTRS+MAXNUMDATA+2)  /* sw may reach 2 words past the end */
+static int* guestMemory;
+static int entryPoint = 0x00400000;     /* where every hart starts */
+
+/*
+ *  Idioms that the fast engine executes as a single fused step. Each
+ *  names the pair of instructions starting at the tagged word.
+ */
+typedef enum {
+    FUSE_NONE = 0,
+    FUSE_LI,            /* lui rt,hi ; ori rt,rt,lo */
+    FUSE_ADDIU_BNE,     /* addiu rt,rs,imm ; bne rt,rx,label */
+    FUSE_SLL_ADDU,      /* sll rd,rt,sa ; addu rd2,rd,rx */
+    FUSE_SLT_BRANCH     /* slt rd,rs,rt ; beq/bne rd,$0,label */
+} Fusion;
+
+/*
+ *  One word of the predecoded text segment. Text cannot be written
+ *  by the simulated program (Mem() only allows stores to the data
+ *  segment), so each word is decoded once, before the first step.
+ */
+typedef struct {
+    unsigned int instr;
+    int valid;          /* FALSE where Decode() would end the program */
+    Fusion fuse;        /* idiom formed with the following word */
+    DecodedInstr d;
+} PredecodedInstr;
+
+static PredecodedInstr stream[MAXNUMINSTRS];
+static Engine engine = ENGINE_FAST;
+
+/* Control-flow graph of the loaded program, built by InitComputer() */
+static ControlFlowGraph cfg;
+
+/*
+ *  Runaway-program detection. At every backward control transfer the
+ *  architectural state -- pc, registers and memGeneration, which
+ *  counts stores that changed memory -- is compared with a snapshot.
+ *  As in Brent's cycle finding algorithm the snapshot is retaken
+ *  whenever the number of comparisons since the last one reaches a
+ *  power of two, so a cycle of states is caught within two periods.
+ */
+typedef struct {
+    int taken;
+    unsigned int hash;
+    int pc;
+    unsigned int memGeneration;
+    int registers[32];
+} StateSnapshot;
+
+static __thread StateSnapshot loopSnapshot;
+static __thread long long loopPower = 1, loopLength = 0;
+static unsigned int memGeneration = 0;
+
+/*
+ *  Index of the nonzero words of the data segment, kept up to date by
+ *  Mem() so that printing all nonzero memory costs time proportional
+ *  to the number of nonzero words. Bit k of nonzeroData is set when
+ *  data word k is nonzero; bit j of nonzeroSummary is set when word j
+ *  of nonzeroData is.
+ */
+#define DATABITWORDS ((MAXNUMDATA+31)/32)
+static unsigned int nonzeroData[DATABITWORDS];
+static unsigned int nonzeroSummary[(DATABITWORDS+31)/32];
+
+static __thread long long retired = 0;  /* instructions completed so far */
+static long long budget = 0;    /* stop after this many; 0 for no limit */
+
+/*
+ *  Counters (see counters.h), kept only while countersActive:
+ *  instructions retired by class, taken conditional branches, and
+ *  instructions that came from the predecoded stream (decode cache
+ *  hits) or went through Decode(). With free-running harts they are
+ *  approximate.
+ */
+typedef enum {
+    CL_ALU=0, CL_SHIFT, CL_IMMEDIATE, CL_LOAD, CL_STORE, CL_BRANCH, CL_JUMP,
+    CL_SYSCALL, CL_OTHER, NUMCLASSES
+} InstrClass;
+
+static const char* classCounterName[NUMCLASSES] = {
+    "retired.alu", "retired.shift", "retired.immediate", "retired.load",
+    "retired.store", "retired.branch", "retired.jump", "retired.syscall",
+    "retired.other"
+};
+static long long classCount[NUMCLASSES];
+static long long takenBranches, decodeHits, decodeMisses;
+
+/*
+ *  Harts. With more than one, each runs the program from its entry point
+ *  on its own thread in quanta of hartQuantum instructions. In
+ *  deterministic mode the harts take turns, in hart order, holding
+ *  hartLock; otherwise they run concurrently and memoryLock orders
+ *  the stores and ll/sc reservations.
+ *
+ *  A hart stops when it reaches the end of the program (instead of
+ *  the whole simulator exiting, as with one hart); it jumps back to
+ *  runExit from wherever that was detected.
+ */
+static int numHarts = 1;
+static int hartQuantum = 100;
+static int deterministicHarts = TRUE;
+static Computer bootState;      /* state every hart starts from */
+static pthread_mutex_t hartLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hartTurn = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t exitLock = PTHREAD_MUTEX_INITIALIZER;  /* taken by the hart that exits */
+static int currentHart;         /* hart whose turn it is, deterministic */
+static int hartDone[MAXHARTS];
+static pthread_mutex_t memoryLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  What ends a run. Normally the end of the program and traps exit the
+ *  simulator. A hart returns to runExit at the end of the program, and
+ *  RunProgram() returns there on either, with the outcome in runStatus
+ *  and runTrap.
+ */
+typedef enum { EXIT_PROCESS=0, EXIT_HART, EXIT_RUN } ExitMode;
+
+static __thread ExitMode exitMode = EXIT_PROCESS;
+static __thread jmp_buf runExit;
+static int runStatus, runTrap;
+
+/*
+ *  Memory from DATABASE up is backed by arena, reserved whole but only
+ *  touched a page at a time. It holds the data segments of an ELF file
+ *  linked at the usual addresses, from DATABASE up to dataBreak, and
+ *  the heap that sbrk grows, from HEAPBASE up to heapBreak.
+ *  arenaPage[k] points at page k once something has been stored there;
+ *  until then it reads as zero.
+ */
+#define PAGEWORDS 1024                  /* 4 KB pages */
+#define DATAPAGES ((HEAPBASE - DATABASE) / (4*PAGEWORDS))
+#define HEAPPAGES 4096                  /* 16 MB of heap at most */
+#define ARENAPAGES (DATAPAGES + HEAPPAGES)
+
+static int* arena;
+static int* arenaPage[ARENAPAGES];
+static unsigned int dataBreak = DATABASE;
+static unsigned int heapBreak = HEAPBASE;
+
+/*
+ *  Console output of the program. It is collected in output and
+ *  written to standard output only when OUTPUTCHUNK bytes have built
+ *  up, before reading input and when the simulator exits. When
+ *  capturing (for the server) it is kept until TakeOutput(), up to
+ *  captureLimit bytes; past that it is dropped and outputLost is set.
+ */
+#define OUTPUTCHUNK 65536
+
+static char* output;
+static size_t outputSize, outputMax;
+static int capturingOutput = FALSE;
+static size_t captureLimit;
+static int outputLost;
+static int holdingOutput = FALSE;      /* lockstep: write only at checkpoints */
+static __thread int syscallSetsV0;     /* the last syscall returned a value in $v0 */
+
+/* ll reservation of each hart: address and whether it still holds */
+static struct {
+    int addr;
+    int valid;
+} reservation[MAXHARTS];
+
+/*
+ *  Lockstep checking (see Lockstep()): the interval between state
+ *  comparisons, 0 when off, and the log of input read so far.
+ */
+static long long lockstepInterval = 0;
+static int* inputLog;
+static int inputLogged, inputLogMax, inputNext;
+
+static void ReadOperands (DecodedInstr*, RegVals*);
+static void IndexDataWord (int);
+static void IndexData ();
+static void FlushOutput ();
+static void ResetArena ();
+static int LoadWord (int);
+static int* ArenaWord (int, int);
+static void RegisterCounters ();
+static void FreeArenaPage (int);
+
+/* Create the host mappings behind guest memory and the arena, once. */
+static void MapGuestMemory () {
+    if (guestMemory != NULL) {
+        return;
+    }
+    guestMemory = mmap (NULL, GUESTWORDS*sizeof(int), PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    arena = mmap (NULL, (size_t)ARENAPAGES*PAGEWORDS*sizeof(int),
+        PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (guestMemory == MAP_FAILED || arena == MAP_FAILED) {
+        fprintf (stderr, "Can't map guest memory.\n");
+        exit (1);
+    }
+}
+
+/*
+ *  Return the host word backing the guest word at addr, in memory or
+ *  anywhere in the arena, or NULL if there is none.
+ */
+int* GuestWord (unsigned int addr) {
+    if (addr % 4 != 0) {
+        return NULL;
+    } else if (addr >= 0x00400000 && addr < 0x00400000 + 4*GUESTWORDS) {
+        return &guestMemory[(addr - 0x00400000) / 4];
+    } else if (addr >= DATABASE && addr - DATABASE < 4LL*PAGEWORDS*ARENAPAGES) {
+        return &arena[(addr - DATABASE) / 4];
+    }
+    return NULL;
+}
+
+/*
+ *  The inverse of GuestWord(): set *addr to the guest address backed
+ *  by the host byte at p and return TRUE, or return FALSE if p backs
+ *  none. Safe in a signal handler.
+ */
+int GuestAddress (const void* p, unsigned int* addr) {
+    const char* c = p;
+    if (guestMemory != NULL && c >= (char*)guestMemory
+        && c < (char*)(guestMemory + GUESTWORDS)) {
+        *addr = 0x00400000 + (c - (char*)guestMemory);
+        return TRUE;
+    } else if (arena != NULL && c >= (char*)arena
+        && c < (char*)(arena + (size_t)PAGEWORDS*ARENAPAGES)) {
+        *addr = DATABASE + (c - (char*)arena);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ *  Return an initialized computer with the stack pointer set to the
+ *  address of the end of data memory, the remaining registers initialized
+ *  to zero, and the instructions read from the given file.
+ *  The file is either a raw dump of instructions for 0x00400000 or an
+ *  ELF executable, which also sets the entry point and $gp.
+ *  The other arguments govern how the program interacts with the user.
+ */
+void InitComputer (FILE* filein, int printingRegisters, int printingMemory,
+  int debugging, int interactive) {
+    int k;
+    unsigned int instr;
+    ElfImage image;
+
+    /* Initialize registers and memory */
+
+    MapGuestMemory ();
+    mips.memory = guestMemory;
+
+    for (k=0; k<32; k++) {
+        mips.registers[k] = 0;
+    }
+    
+    /* stack pointer - Initialize to highest address of data segment */
+    mips.registers[29] = 0x00400000 + (MAXNUMINSTRS+MAXNUMDATA)*4;
+
+    for (k=0; k<MAXNUMINSTRS+MAXNUMDATA; k++) {
+        mips.memory[k] = 0;
+    }
+
+    k = 0;
+    if (IsElf (filein)) {
+        LoadElf (filein, &image);
+        k = image.textWords;
+        dataBreak = image.dataEnd;
+        entryPoint = image.entry;
+        mips.registers[28] = image.gp;
+    } else while (fread(&instr, 4, 1, filein)) {
+	/*swap to big endian, convert to host byte order. Ignore this.*/
+        mips.memory[k] = ntohl(endianSwap(instr));
+        k++;
+        if (k>MAXNUMINSTRS) {
+            fprintf (stderr, "Program too big.\n");
+            exit (1);
+        }
+    }
+
+    mips.numInstrs = k;
+
+    mips.printingRegisters = printingRegisters;
+    mips.printingMemory = printingMemory;
+    mips.interactive = interactive;
+    mips.debugging = debugging;
+
+    BuildCFG (&cfg, mips.memory, mips.numInstrs, entryPoint);
+    IndexData ();
+    atexit (FlushOutput);
+    RegisterCounters ();
+}
+
+static void RegisterCounters () {
+    int c;
+    for (c=0; c<NUMCLASSES; c++) {
+        RegisterCounter (classCounterName[c], &classCount[c]);
+    }
+    RegisterCounter ("branches.taken", &takenBranches);
+    RegisterCounter ("decode.cached", &decodeHits);
+    RegisterCounter ("decode.decoded", &decodeMisses);
+}
+
+/*
+ *  Record the current value of the word at mips.memory[k] in the
+ *  nonzero index. Words outside the data segment are ignored.
+ */
+static void IndexDataWord (int k) {
+    int word;
+    k -= MAXNUMINSTRS;
+    if (k < 0 || k >= MAXNUMDATA) {
+        return;
+    }
+    word = k/32;
+    if (mips.memory[MAXNUMINSTRS+k] != 0) {
+        nonzeroData[word] |= 1u << (k%32);
+    } else {
+        nonzeroData[word] &= ~(1u << (k%32));
+    }
+    if (nonzeroData[word] != 0) {
+        nonzeroSummary[word/32] |= 1u << (word%32);
+    } else {
+        nonzeroSummary[word/32] &= ~(1u << (word%32));
+    }
+}
+
+/* Rebuild the nonzero index from the whole data segment. */
+static void IndexData () {
+    int k;
+    memset (nonzeroData, 0, sizeof(nonzeroData));
+    memset (nonzeroSummary, 0, sizeof(nonzeroSummary));
+    for (k=MAXNUMINSTRS; k<MAXNUMINSTRS+MAXNUMDATA; k++) {
+        IndexDataWord (k);
+    }
+}
+
+/*
+ *  Replace the loaded program with the dump image of the given size,
+ *  leaving everything else as InitComputer() set it. Only the memory
+ *  the previous run could have changed is cleared: its text, the
+ *  words past the end and the nonzero data words. Any ll reservation
+ *  the previous run left is dropped too, so its sc can't succeed for
+ *  the next program. Return FALSE if the image is too big.
+ */
+int LoadProgram (const char* image, int bytes) {
+    unsigned int instr;
+    int k, n = bytes/4;
+
+    if (n > MAXNUMINSTRS+1) {
+        return FALSE;
+    }
+    MapGuestMemory ();
+    mips.memory = guestMemory;
+    entryPoint = 0x00400000;
+    ResetArena ();
+    outputSize = 0;
+    outputLost = FALSE;
+    for (k=0; k<MAXHARTS; k++) {
+        reservation[k].valid = FALSE;
+    }
+    for (k=0; k<mips.numInstrs; k++) {
+        mips.memory[k] = 0;
+    }
+    mips.memory[MAXNUMINSTRS+MAXNUMDATA] = mips.memory[MAXNUMINSTRS+MAXNUMDATA+1] = 0;
+    for (k=NextNonzeroWord(0); k >= 0; k=NextNonzeroWord(k+1)) {
+        mips.memory[k] = 0;
+    }
+    for (k=0; k<n; k++) {
+        memcpy (&instr, image+4*k, 4);
+        mips.memory[k] = ntohl(endianSwap(instr));
+    }
+    mips.numInstrs = n;
+    for (k=0; k<32; k++) {
+        mips.registers[k] = 0;
+    }
+    mips.registers[29] = 0x00400000 + (MAXNUMINSTRS+MAXNUMDATA)*4;
+
+    BuildCFG (&cfg, mips.memory, mips.numInstrs, entryPoint);
+    IndexData ();
+    return TRUE;
+}
+
+/*
+ *  Return the index in mips.memory of the first nonzero data word at
+ *  or after index k, or -1 if there is none.
+ */
+int NextNonzeroWord (int k) {
+    unsigned int bits, summary;
+    int word;
+
+    k = k < MAXNUMINSTRS ? 0 : k - MAXNUMINSTRS;
+    if (k >= MAXNUMDATA) {
+        return -1;
+    }
+    word = k/32;
+    bits = nonzeroData[word] & (~0u << (k%32));
+    while (bits == 0) {
+        if (++word >= DATABITWORDS) {
+            return -1;
+        }
+        summary = nonzeroSummary[word/32] & (~0u << (word%32));
+        if (summary == 0) {
+            word = (word/32+1)*32 - 1;     /* skip the rest of this summary word */
+            continue;
+        }
+        word = (word/32)*32 + __builtin_ctz(summary);
+        bits = nonzeroData[word];
+    }
+    return MAXNUMINSTRS + word*32 + __builtin_ctz(bits);
+}
+
+/* Return the control-flow graph of the program loaded by InitComputer(). */
+ControlFlowGraph* ProgramCFG () {
+    return &cfg;
+}
+
+unsigned int endianSwap(unsigned int i) {
+    return (i>>24)|(i>>8&0x0000ff00)|(i<<8&0x00ff0000)|(i<<24);
+}
+
+/*
+ *  Select the engine Simulate() uses. The reference engine runs every
+ *  instruction through Fetch/Decode/Execute/Mem/RegWrite; the fast
+ *  engine runs the predecoded text segment and fuses common idioms.
+ *  Both produce the same output.
+ */
+void SelectEngine (Engine e) {
+    engine = e;
+}
+
+/*
+ *  Stop the simulation after n instructions, or never if n is 0.
+ */
+void SetInstructionBudget (long long n) {
+    budget = n;
+}
+
+/*
+ *  The running hart has reached the end of the program. With a single
+ *  hart the simulator exits, as it always has.
+ */
+static void EndProgram () {
+    PHASE(PH_NONE);
+    if (exitMode != EXIT_PROCESS) {
+        runStatus = 0;
+        runTrap = -1;
+        longjmp (runExit, 1);
+    }
+    exit (0);
+}
+
+/*
+ *  Stop the simulation because of an error or a limit: report it to
+ *  the event sinks and exit with the given status. pc is the
+ *  instruction responsible and addr the address involved, if any.
+ */
+static void Trap (TrapKind kind, int pc, int addr, int status, char* message) {
+    SimEvent e;
+    PHASE(PH_NONE);
+    if (eventsActive) {
+        e.kind = EV_TRAP;
+        e.pc = pc;
+        e.hart = mips.hart;
+        e.addr = addr;
+        e.trap = kind;
+        e.message = message;
+        Emit (&e);
+    }
+    if (exitMode == EXIT_RUN) {
+        runStatus = status;
+        runTrap = kind;
+        longjmp (runExit, 1);
+    }
+    /* several harts may trap at once; the exit handlers must run only once */
+    pthread_mutex_lock (&exitLock);
+    exit (status);
+}
+
+/* FNV-1a hash of the state compared by CheckLoop(). */
+static unsigned int StateHash () {
+    unsigned int h = 2166136261u;
+    int k;
+    h = (h ^ (unsigned int)mips.pc) * 16777619u;
+    h = (h ^ memGeneration) * 16777619u;
+    for (k=0; k<32; k++) {
+        h = (h ^ (unsigned int)mips.registers[k]) * 16777619u;
+    }
+    return h;
+}
+
+/*
+ *  Called after each backward control transfer. End the program if
+ *  the state matches the snapshot: with no input, it would repeat
+ *  the same instructions forever.
+ */
+static void CheckLoop () {
+    char message[100];
+    unsigned int h = StateHash ();
+    if (loopSnapshot.taken && h == loopSnapshot.hash
+        && mips.pc == loopSnapshot.pc
+        && memGeneration == loopSnapshot.memGeneration
+        && memcmp(mips.registers, loopSnapshot.registers,
+            sizeof(mips.registers)) == 0) {
+        sprintf (message, "Infinite loop at 0x%8.8x: state repeated after %lld instructions",
+            mips.pc, retired);
+        Trap (TRAP_LIVELOCK, mips.pc, mips.pc, EXIT_LIVELOCK, message);
+    }
+    if (++loopLength == loopPower) {
+        loopSnapshot.taken = TRUE;
+        loopSnapshot.hash = h;
+        loopSnapshot.pc = mips.pc;
+        loopSnapshot.memGeneration = memGeneration;
+        memcpy(loopSnapshot.registers, mips.registers, sizeof(mips.registers));
+        loopPower *= 2;
+        loopLength = 0;
+    }
+}
+
+/*
+ *  Enforce the instruction budget and look for a runaway loop after a
+ *  step that started at oldPc.
+ */
+static void CheckLimits (int oldPc) {
+    char message[100];
+    /*
+     * With several harts one may wait in a loop for another, which
+     * needn't store anything meanwhile, so repeated states prove
+     * nothing; only the budget applies.
+     */
+    if ((unsigned int)mips.pc <= (unsigned int)oldPc && numHarts == 1) {
+        CheckLoop ();
+    }
+    if (countersRequested) {
+        DumpCounters ();
+    }
+    if (budget != 0 && retired >= budget) {
+        sprintf (message, "Instruction budget of %lld exhausted at 0x%8.8x",
+            budget, mips.pc);
+        Trap (TRAP_BUDGET, mips.pc, mips.pc, EXIT_BUDGET, message);
+    }
+}
+
+/*
+ *  Return the idiom formed by the instruction a followed by b, or
+ *  FUSE_NONE. Only pairs where b consumes the result of a qualify.
+ */
+static Fusion FusionOf (DecodedInstr* a, DecodedInstr* b) {
+    if (a->type == I && a->op == 15 && b->type == I && b->op == 13
+        && b->regs.i.rs == a->regs.i.rt && b->regs.i.rt == a->regs.i.rt) {
+        return FUSE_LI;
+    }
+    if (a->type == I && a->op == 9 && b->type == I && b->op == 5
+        && (b->regs.i.rs == a->regs.i.rt || b->regs.i.rt == a->regs.i.rt)) {
+        return FUSE_ADDIU_BNE;
+    }
+    if (a->type == R && a->regs.r.funct == 0 && b->type == R
+        && b->regs.r.funct == 33
+        && (b->regs.r.rs == a->regs.r.rd || b->regs.r.rt == a->regs.r.rd)) {
+        return FUSE_SLL_ADDU;
+    }
+    if (a->type == R && a->regs.r.funct == 42 && b->type == I
+        && (b->op == 4 || b->op == 5)
+        && b->regs.i.rs == a->regs.r.rd && b->regs.i.rt == 0) {
+        return FUSE_SLT_BRANCH;
+    }
+    return FUSE_NONE;
+}
+
+/*
+ *  Decode every word of the text segment into stream[] and tag the
+ *  fusible pairs. A pair never straddles a basic block boundary, so
+ *  the second word is only ever reached through the first.
+ */
+static void Predecode () {
+    int k;
+    for (k=0; k<MAXNUMINSTRS; k++) {
+        stream[k].instr = mips.memory[k];
+        stream[k].valid = DecodeFields(stream[k].instr, 0x00400000+4*k,
+            &stream[k].d);
+        stream[k].fuse = FUSE_NONE;
+    }
+    for (k=0; k+1<MAXNUMINSTRS; k++) {
+        if (stream[k].valid && stream[k+1].valid && !IsLeader(&cfg, k+1)) {
+            stream[k].fuse = FusionOf(&stream[k].d, &stream[k+1].d);
+        }
+    }
+}
+
+/*
+ *  Print the fetch and disassembly lines for the predecoded word p,
+ *  which is about to execute at mips.pc. Like Decode(), end the
+ *  program if p is not an instruction we simulate.
+ */
+static void TraceInstr (PredecodedInstr* p) {
+    SimEvent e;
+    if (countersActive) {
+        PHASE(PH_PRINT);
+        decodeHits++;
+    }
+    if (eventsActive) {
+        e.kind = EV_FETCH;
+        e.hart = mips.hart;
+        e.pc = mips.pc;
+        e.instr = p->instr;
+        Emit (&e);
+    }
+    if (!p->valid) {
+        EndProgram ();
+    }
+    if (eventsActive) {
+        e.kind = EV_DECODE;
+        e.d = &p->d;
+        Emit (&e);
+    }
+    PHASE(PH_EXECUTE);
+}
+
+/* The class of instruction d, for the counters. */
+static InstrClass ClassOf (DecodedInstr* d) {
+    switch (d->type) {
+        case R:
+            switch (d->regs.r.funct) {
+                case 0: case 2: return CL_SHIFT;
+                case 8: return CL_JUMP;
+                case 12: return CL_SYSCALL;
+                case 33: case 35: case 36: case 37: case 42: return CL_ALU;
+            }
+        break;
+        case I:
+            switch (d->op) {
+                case 4: case 5: return CL_BRANCH;
+                case 9: case 12: case 13: case 15: return CL_IMMEDIATE;
+                case 35: case 48: return CL_LOAD;
+                case 43: case 56: return CL_STORE;
+            }
+        break;
+        case J:
+            return CL_JUMP;
+    }
+    return CL_OTHER;
+}
+
+/* Count the instruction d at pc, which has just completed. */
+static void CountInstr (int pc, DecodedInstr* d) {
+    InstrClass c = ClassOf (d);
+    classCount[c]++;
+    if (c == CL_BRANCH && (mips.registers[d->regs.i.rs] == mips.registers[d->regs.i.rt])
+        == (d->op == 4)) {
+        takenBranches++;
+    }
+}
+
+/*
+ *  Report the effects of the instruction d at pc, which has just
+ *  completed: the register and memory location it changed, if any,
+ *  the outcome of a branch or jump and finally its retirement.
+ */
+static void Retire (int pc, DecodedInstr* d, int changedReg, int changedMem) {
+    SimEvent e;
+    if (countersActive) {
+        PHASE(PH_PRINT);
+        CountInstr (pc, d);
+    }
+    if (!eventsActive) {
+        return;
+    }
+    e.hart = mips.hart;
+    e.pc = pc;
+    if (changedReg != -1) {
+        e.kind = EV_REGWRITE;
+        e.reg = changedReg;
+        e.value = mips.registers[changedReg];
+        Emit (&e);
+    }
+    if (changedMem != -1) {
+        e.kind = EV_MEMWRITE;
+        e.addr = changedMem;
+        e.value = Fetch (changedMem);
+        Emit (&e);
+    }
+    if (d->type == J || (d->type == I && (d->op == 4 || d->op == 5))
+        || (d->type == R && d->regs.r.funct == 8)) {
+        e.kind = EV_BRANCH;
+        if (d->type == J) {
+            e.target = d->regs.j.target;
+        } else if (d->type == I) {
+            e.target = pc + 4 + (d->regs.i.addr_or_immed << 2);
+        } else {
+            e.target = mips.pc;
+        }
+        if (d->type == I) {
+            e.taken = (mips.registers[d->regs.i.rs] == mips.registers[d->regs.i.rt])
+                == (d->op == 4);
+        } else {
+            e.taken = TRUE;
+        }
+        Emit (&e);
+    }
+    e.kind = EV_RETIRE;
+    e.nextPc = mips.pc;
+    e.changedReg = changedReg;
+    e.changedMem = changedMem;
+    Emit (&e);
+}
+
+/*
+ *  The event sink for the original trace format: the fetched word,
+ *  its disassembly and the state printed by PrintInfo().
+ */
+void TextSink (SimEvent* e, void* arg) {
+    flockfile (stdout);
+    switch (e->kind) {
+        case EV_FETCH:
+            if (numHarts > 1) {
+                printf ("[hart %d] ", e->hart);
+            }
+            printf ("Executing instruction at %8.8x: %8.8x\n", e->pc, e->instr);
+        break;
+        case EV_DECODE:
+            PrintInstruction (e->d);
+        break;
+        case EV_TRAP:
+            printf ("%s\n", e->message);
+        break;
+        case EV_RETIRE:
+            PrintInfo (e->changedReg, e->changedMem);
+        break;
+        default:
+        break;
+    }
+    funlockfile (stdout);
+}
+
+/*
+ *  Simulate one instruction with the reference pipeline.
+ */
+static void Step () {
+    unsigned int instr;
+    int changedReg=-1, changedMem=-1, val, pc = mips.pc;
+    DecodedInstr d;
+    SimEvent e;
+
+    START_TIMING();
+
+    /* Fetch instr at mips.pc, returning it in instr */
+    instr = Fetch (mips.pc);
+
+    if (eventsActive) {
+        PHASE(PH_PRINT);
+        e.kind = EV_FETCH;
+        e.hart = mips.hart;
+        e.pc = pc;
+        e.instr = instr;
+        Emit (&e);
+    }
+
+    /* 
+     * Decode instr, putting decoded instr in d
+     * Note that we reuse the d struct for each instruction.
+     */
+    PHASE(PH_DECODE);
+    if (countersActive) {
+        decodeMisses++;
+    }
+    Decode (instr, &d, &rVals);
+
+    /*Report decoded instruction*/
+    if (eventsActive) {
+        PHASE(PH_PRINT);
+        e.kind = EV_DECODE;
+        e.d = &d;
+        Emit (&e);
+    }
+
+    /* 
+     * Perform computation needed to execute d, returning computed value 
+     * in val 
+     */
+    PHASE(PH_EXECUTE);
+    val = Execute(&d, &rVals); // val will have return value of temp in execute();
+
+    UpdatePC(&d,val);
+
+    /* 
+     * Perform memory load or store. Place the
+     * address of any updated memory in *changedMem, 
+     * otherwise put -1 in *changedMem. 
+     * Return any memory value that is read, otherwise return -1.
+     */
+    PHASE(PH_MEMORY);
+    val = Mem(&d, val, &changedMem);
+
+    /* 
+     * Write back to register. If the instruction modified a register--
+     * (including jal, which modifies $ra) --
+     * put the index of the modified register in *changedReg,
+     * otherwise put -1 in *changedReg.
+     */
+    PHASE(PH_WRITEBACK);
+    RegWrite(&d, val, &changedReg);
+
+    Retire (pc, &d, changedReg, changedMem);
+    retired++;
+    PHASE(PH_NONE);
+}
+
+/*
+ *  Simulate one dispatch of the fast engine: either the single
+ *  predecoded instruction at mips.pc or, if it starts a fused idiom,
+ *  the pair. Both instructions of a pair are still traced.
+ */
+static void FastStep () {
+    unsigned int k = (unsigned int)(mips.pc - 0x00400000) / 4;
+    int changedReg, changedMem, val, pc = mips.pc;
+    PredecodedInstr *p, *q;
+
+    if ((mips.pc & 3) != 0 || k >= MAXNUMINSTRS) {
+        Step ();        /* outside the text segment */
+        return;
+    }
+    START_TIMING();
+    p = &stream[k];
+    q = p+1;
+    TraceInstr(p);
+    switch (p->fuse) {
+        case FUSE_LI:
+            mips.registers[p->d.regs.i.rt] = p->d.regs.i.addr_or_immed << 16;
+            mips.pc += 4;
+            Retire (pc, &p->d, p->d.regs.i.rt, -1);
+            TraceInstr(q);
+            mips.registers[q->d.regs.i.rt] =
+                mips.registers[q->d.regs.i.rs] | q->d.regs.i.addr_or_immed;
+            mips.pc += 4;
+            Retire (pc+4, &q->d, q->d.regs.i.rt, -1);
+        break;
+        case FUSE_ADDIU_BNE:
+            mips.registers[p->d.regs.i.rt] =
+                mips.registers[p->d.regs.i.rs] + p->d.regs.i.addr_or_immed;
+            mips.pc += 4;
+            Retire (pc, &p->d, p->d.regs.i.rt, -1);
+            TraceInstr(q);
+            mips.pc += 4;
+            if (mips.registers[q->d.regs.i.rs] != mips.registers[q->d.regs.i.rt]) {
+                mips.pc += q->d.regs.i.addr_or_immed << 2;
+            }
+            Retire (pc+4, &q->d, -1, -1);
+        break;
+        case FUSE_SLL_ADDU:
+            mips.registers[p->d.regs.r.rd] =
+                mips.registers[p->d.regs.r.rt] << p->d.regs.r.shamt;
+            mips.pc += 4;
+            Retire (pc, &p->d, p->d.regs.r.rd, -1);
+            TraceInstr(q);
+            mips.registers[q->d.regs.r.rd] =
+                mips.registers[q->d.regs.r.rs] + mips.registers[q->d.regs.r.rt];
+            mips.pc += 4;
+            Retire (pc+4, &q->d, q->d.regs.r.rd, -1);
+        break;
+        case FUSE_SLT_BRANCH:
+            mips.registers[p->d.regs.r.rd] =
+                (mips.registers[p->d.regs.r.rs] - mips.registers[p->d.regs.r.rt]) < 0;
+            mips.pc += 4;
+            Retire (pc, &p->d, p->d.regs.r.rd, -1);
+            TraceInstr(q);
+            mips.pc += 4;
+            if ((mips.registers[q->d.regs.i.rs] == mips.registers[q->d.regs.i.rt])
+                == (q->d.op == 4)) {
+                mips.pc += q->d.regs.i.addr_or_immed << 2;
+            }
+            Retire (pc+4, &q->d, -1, -1);
+        break;
+        default:
+            ReadOperands(&p->d, &rVals);
+            val = Execute(&p->d, &rVals);
+            UpdatePC(&p->d, val);
+            PHASE(PH_MEMORY);
+            val = Mem(&p->d, val, &changedMem);
+            PHASE(PH_WRITEBACK);
+            RegWrite(&p->d, val, &changedReg);
+            Retire (pc, &p->d, changedReg, changedMem);
+        break;
+    }
+    /* counted only now, as Step() does, in case Mem() trapped */
+    retired += p->fuse == FUSE_NONE ? 1 : 2;
+    PHASE(PH_NONE);
+}
+
+/*
+ *  Run up to n instructions (forever if n is 0) on the current hart.
+ */
+static void Run (long long n) {
+    long long stop = retired + n;
+    int pc;
+
+    if (engine == ENGINE_FAST) {
+        while (n == 0 || retired < stop) {
+            pc = mips.pc;
+            if ((budget != 0 && retired+1 == budget)
+                || (n != 0 && retired+1 == stop)) {
+                Step ();        /* a fused pair would overrun the limit */
+            } else {
+                FastStep ();
+            }
+            CheckLimits (pc);
+        }
+    } else {
+        while (n == 0 || retired < stop) {
+            pc = mips.pc;
+            Step ();
+            CheckLimits (pc);
+        }
+    }
+}
+
+/*
+ *  For the debugger: run up to n instructions (without limit if n is
+ *  0), stopping early after a store to a watched word or on reaching a
+ *  breakpoint whose condition holds. Return TRUE if stopped early.
+ */
+int RunToStop (long long n) {
+    long long stop = retired + n;
+    unsigned int k;
+    int pc;
+
+    debugStop = FALSE;
+    while (n == 0 || retired < stop) {
+        pc = mips.pc;
+        k = (unsigned int)(pc - 0x00400000) / 4;
+        if (engine == ENGINE_FAST && !IsBreakWord(k+1)
+            && !(budget != 0 && retired+1 == budget)
+            && !(n != 0 && retired+1 == stop)) {
+            FastStep ();        /* can't fuse past a breakpoint or a limit */
+        } else {
+            Step ();
+        }
+        if (watchFault) {
+            FinishWatch (pc);   /* the step stored to a watched page */
+        }
+        CheckLimits (pc);
+        k = (unsigned int)(mips.pc - 0x00400000) / 4;
+        if (debugStop || (IsBreakWord(k) && BreakHere(mips.pc))) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ *  For the server: run the program loaded by LoadProgram() from the
+ *  start on a single hart, with a budget of n instructions (0 for no
+ *  limit). Return the status the simulator would have exited with.
+ *  *trap gets the TrapKind that stopped the program, or -1 if it ran
+ *  to the end, and *count the number of instructions retired.
+ */
+int RunProgram (long long n, int* trap, long long* count) {
+    budget = n;
+    retired = 0;
+    loopSnapshot.taken = FALSE;
+    loopPower = 1;
+    loopLength = 0;
+    memGeneration = 0;
+    mips.pc = entryPoint;
+    if (engine == ENGINE_FAST) {
+        Predecode ();
+    }
+    exitMode = EXIT_RUN;
+    if (setjmp (runExit) == 0) {
+        Run (0);
+    }
+    exitMode = EXIT_PROCESS;
+    *trap = runTrap;
+    *count = retired;
+    return runStatus;
+}
+
+/*
+ *  Lockstep checking of the fast engine against the reference engine.
+ *  Every lockstepInterval instructions the fast engine's run since the
+ *  last checkpoint is repeated by the reference engine from that
+ *  checkpoint, and the two are compared by a hash of the architectural
+ *  state. Only the fast engine's run is traced. Program output is held
+ *  back until the checkpoint after it has been checked, even when the
+ *  program reads input.
+ *
+ *  On a mismatch the interval is bisected down to an instruction that
+ *  leaves different states from the same one. If an earlier difference
+ *  was later overwritten, that instruction need not be the first to
+ *  differ; a smaller interval finds it sooner.
+ */
+typedef struct {
+    Computer mips;
+    int memory[GUESTWORDS];
+    int* arenaPage[ARENAPAGES];         /* copies of the allocated pages */
+    unsigned int heapBreak;
+    unsigned int memGeneration;
+    long long retired;
+    StateSnapshot loopSnapshot;
+    long long loopPower, loopLength;
+    size_t outputSize;
+    int inputNext;
+    int reservationAddr, reservationValid;
+} Checkpoint;
+
+/* How a run of one engine from a checkpoint turned out. */
+typedef struct {
+    unsigned int hash;
+    long long retired;
+    int ended;          /* the program stopped, with status and trap */
+    int status, trap;
+} Outcome;
+
+static void SaveCheckpoint (Checkpoint* c) {
+    int k;
+    c->mips = mips;
+    memcpy (c->memory, guestMemory, sizeof(c->memory));
+    for (k=0; k<ARENAPAGES; k++) {
+        if (arenaPage[k] == NULL) {
+            free (c->arenaPage[k]);
+            c->arenaPage[k] = NULL;
+            continue;
+        }
+        if (c->arenaPage[k] == NULL) {
+            c->arenaPage[k] = malloc (PAGEWORDS*sizeof(int));
+            if (c->arenaPage[k] == NULL) {
+                fprintf (stderr, "Out of memory for a checkpoint.\n");
+                exit (1);
+            }
+        }
+        memcpy (c->arenaPage[k], arenaPage[k], PAGEWORDS*sizeof(int));
+    }
+    c->heapBreak = heapBreak;
+    c->memGeneration = memGeneration;
+    c->retired = retired;
+    c->loopSnapshot = loopSnapshot;
+    c->loopPower = loopPower;
+    c->loopLength = loopLength;
+    c->outputSize = outputSize;
+    c->inputNext = inputNext;
+    c->reservationAddr = reservation[0].addr;
+    c->reservationValid = reservation[0].valid;
+}
+
+static void RestoreCheckpoint (Checkpoint* c) {
+    int k;
+    mips = c->mips;
+    memcpy (guestMemory, c->memory, sizeof(c->memory));
+    for (k=0; k<ARENAPAGES; k++) {
+        if (c->arenaPage[k] != NULL) {
+            memcpy (ArenaWord(DATABASE + 4*k*PAGEWORDS, TRUE), c->arenaPage[k],
+                PAGEWORDS*sizeof(int));
+        } else {
+            FreeArenaPage (k);
+        }
+    }
+    heapBreak = c->heapBreak;
+    memGeneration = c->memGeneration;
+    retired = c->retired;
+    loopSnapshot = c->loopSnapshot;
+    loopPower = c->loopPower;
+    loopLength = c->loopLength;
+    outputSize = c->outputSize;
+    inputNext = c->inputNext;
+    reservation[0].addr = c->reservationAddr;
+    reservation[0].valid = c->reservationValid;
+    IndexData ();
+}
+
+#define MIX(h, v) ((h) = ((h) ^ (unsigned int)(v)) * 16777619u)
+
+/*
+ *  FNV-1a hash of everything the program can observe: pc, registers,
+ *  memory, the arena, the ll reservation and the output not yet written.
+ */
+static unsigned int ArchHash () {
+    unsigned int h = 2166136261u;
+    int k, j;
+    size_t n;
+    MIX(h, mips.pc);
+    for (k=0; k<32; k++) {
+        MIX(h, mips.registers[k]);
+    }
+    for (k=0; k<GUESTWORDS; k++) {
+        MIX(h, guestMemory[k]);
+    }
+    MIX(h, heapBreak);
+    for (k=0; k<ARENAPAGES; k++) {
+        for (j=0; arenaPage[k] != NULL && j<PAGEWORDS; j++) {
+            if (arenaPage[k][j] != 0) {      /* a page of zeros reads as no page */
+                MIX(h, k*PAGEWORDS + j);
+                MIX(h, arenaPage[k][j]);
+            }
+        }
+    }
+    MIX(h, reservation[0].valid ? reservation[0].addr : 0);
+    MIX(h, outputSize);
+    for (n=0; n<outputSize; n++) {
+        MIX(h, output[n]);
+    }
+    MIX(h, inputNext);
+    return h;
+}
+
+/*
+ *  Run engine e for at least n instructions, or until the program
+ *  stops, and describe the result in *o. The fast engine may run one
+ *  more to finish a fused pair. Events are reported unless quiet.
+ */
+static void RunEngine (Engine e, long long n, int quiet, Outcome* o) {
+    long long stop = retired + n;
+    int active = eventsActive;
+    int pc;
+
+    if (quiet) {
+        eventsActive = FALSE;
+    }
+    exitMode = EXIT_RUN;
+    o->ended = FALSE;
+    if (setjmp (runExit) == 0) {
+        while (retired < stop) {
+            pc = mips.pc;
+            if (e == ENGINE_FAST && !(budget != 0 && retired+1 == budget)) {
+                FastStep ();
+            } else {
+                Step ();
+            }
+            CheckLimits (pc);
+        }
+    } else {
+        o->ended = TRUE;
+        o->status = runStatus;
+        o->trap = runTrap;
+    }
+    exitMode = EXIT_PROCESS;
+    eventsActive = active;
+    o->retired = retired;
+    o->hash = ArchHash ();
+}
 
-/*Globally accessible Computer variable*/
-Computer mips;
-RegVals rVals;
+static int SameOutcome (Outcome* a, Outcome* b) {
+    return a->hash == b->hash && a->retired == b->retired && a->ended == b->ended
+        && (!a->ended || (a->status == b->status && a->trap == b->trap));
+}
 
 /*
- *  Return an initialized computer with the stack pointer set to the
- *  address of the end of data memory, the remaining registers initialized
- *  to zero, and the instructions read from the given file.
- *  The other arguments govern how the program interacts with the user.
+ *  Run the fast engine for about n instructions from checkpoint c and
+ *  then the reference engine for as many, or for n if the fast engine
+ *  stopped early, so that it reaches the same stop. This leaves the
+ *  reference engine's state. Return TRUE if they agree; *fast gets the
+ *  fast engine's outcome.
  */
-void InitComputer (FILE* filein, int printingRegisters, int printingMemory,
-  int debugging, int interactive) {
-    int k;
-    unsigned int instr;
-
-    /* Initialize registers and memory */
+static int CheckInterval (Checkpoint* c, long long n, int quiet, Outcome* fast) {
+    Outcome reference;
+    RunEngine (ENGINE_FAST, n, quiet, fast);
+    RestoreCheckpoint (c);
+    RunEngine (ENGINE_REFERENCE, fast->ended ? n : fast->retired - c->retired,
+        TRUE, &reference);
+    return SameOutcome (fast, &reference);
+}
 
-    for (k=0; k<32; k++) {
-        mips.registers[k] = 0;
+static void DescribeOutcome (const char* engineName, Outcome* o) {
+    fprintf (stderr, "  %s engine: %lld instructions, ", engineName, o->retired);
+    if (!o->ended) {
+        fprintf (stderr, "still running\n");
+    } else if (o->trap == -1) {
+        fprintf (stderr, "program ended with status %d\n", o->status);
+    } else {
+        fprintf (stderr, "stopped by a trap with status %d\n", o->status);
     }
-    
-    /* stack pointer - Initialize to highest address of data segment */
-    mips.registers[29] = 0x00400000 + (MAXNUMINSTRS+MAXNUMDATA)*4;
+}
 
-    for (k=0; k<MAXNUMINSTRS+MAXNUMDATA; k++) {
-        mips.memory[k] = 0;
-    }
+/*
+ *  The engines agree at checkpoint c and disagree n instructions
+ *  later. Narrow that down to one dispatch of the fast engine -- a
+ *  single instruction or a fused pair -- by bisection, advancing c
+ *  past every half where they agree, and report how its results differ.
+ */
+static void Bisect (Checkpoint* c, long long n) {
+    static Checkpoint fastState;
+    Outcome fast, reference;
+    long long lo = c->retired, hi = lo + n;
+    char message[120];
+    int k, pc;
 
-    k = 0;
-    while (fread(&instr, 4, 1, filein)) {
-	/*swap to big endian, convert to host byte order. Ignore this.*/
-        mips.memory[k] = ntohl(endianSwap(instr));
-        k++;
-        if (k>MAXNUMINSTRS) {
-            fprintf (stderr, "Program too big.\n");
-            exit (1);
+    while (hi - lo > 1) {
+        RestoreCheckpoint (c);
+        if (CheckInterval (c, (hi - lo) / 2, TRUE, &fast)) {
+            SaveCheckpoint (c);
+            lo = fast.retired;
+        } else if (fast.retired >= hi) {
+            break;      /* the first dispatch is a pair, and it differs */
+        } else {
+            hi = fast.retired;
         }
     }
 
-    mips.printingRegisters = printingRegisters;
-    mips.printingMemory = printingMemory;
-    mips.interactive = interactive;
-    mips.debugging = debugging;
+    /* rerun the dispatch at lo on both engines, keeping both states */
+    RestoreCheckpoint (c);
+    RunEngine (ENGINE_FAST, 1, TRUE, &fast);
+    SaveCheckpoint (&fastState);
+    RestoreCheckpoint (c);
+    RunEngine (ENGINE_REFERENCE, fast.ended ? 1 : fast.retired - lo, TRUE, &reference);
+
+    pc = c->mips.pc;
+    fprintf (stderr, "Engines diverged after %lld instructions, in the instruction at %8.8x: %8.8x\n",
+        lo, pc, Fetch (pc));
+    if (fast.retired - lo == 2) {
+        fprintf (stderr, "  fused with the one at %8.8x: %8.8x\n", pc+4, Fetch (pc+4));
+    }
+    if (fastState.mips.pc != mips.pc) {
+        fprintf (stderr, "  pc: reference %8.8x, fast %8.8x\n", mips.pc, fastState.mips.pc);
+    }
+    for (k=0; k<32; k++) {
+        if (fastState.mips.registers[k] != mips.registers[k]) {
+            fprintf (stderr, "  r%2.2d: reference %8.8x, fast %8.8x\n",
+                k, mips.registers[k], fastState.mips.registers[k]);
+        }
+    }
+    for (k=0; k<GUESTWORDS; k++) {
+        if (fastState.memory[k] != guestMemory[k]) {
+            fprintf (stderr, "  memory at %8.8x: reference %8.8x, fast %8.8x\n",
+                0x00400000+4*k, guestMemory[k], fastState.memory[k]);
+        }
+    }
+    if (fastState.outputSize != outputSize) {
+        fprintf (stderr, "  output: reference %lu bytes, fast %lu bytes\n",
+            (unsigned long)outputSize, (unsigned long)fastState.outputSize);
+    }
+    if (fast.ended != reference.ended || fast.retired != reference.retired
+        || (fast.ended && (fast.status != reference.status || fast.trap != reference.trap))) {
+        DescribeOutcome ("reference", &reference);
+        DescribeOutcome ("fast", &fast);
+    }
+    sprintf (message, "Engines diverged at 0x%8.8x after %lld instructions", pc, lo);
+    Trap (TRAP_DIVERGENCE, pc, pc, EXIT_DIVERGED, message);
 }
 
-unsigned int endianSwap(unsigned int i) {
-    return (i>>24)|(i>>8&0x0000ff00)|(i<<8&0x00ff0000)|(i<<24);
+/*
+ *  Check the fast engine against the reference engine every n
+ *  instructions (0 to turn checking off). Only for a single hart.
+ */
+void SetLockstep (long long n) {
+    lockstepInterval = n;
 }
 
 /*
- *  Run the simulation.
+ *  Run the program with lockstep checking. When the engines disagree,
+ *  find and report the first instruction they disagree on and stop.
  */
-void Simulate () {
-    char s[40];  /* used for handling interactive input */
-    unsigned int instr;
-    int changedReg=-1, changedMem=-1, val;
-    DecodedInstr d;
-    
-    /* Initialize the PC to the start of the code section */
-    mips.pc = 0x00400000;
+static void Lockstep () {
+    static Checkpoint checkpoint;
+    Outcome fast;
+
+    holdingOutput = TRUE;
     while (1) {
-        if (mips.interactive) {
-            printf ("> ");
-            fgets (s,sizeof(s),stdin);
-            if (s[0] == 'q') {
-                return;
-            }
+        holdingOutput = FALSE;
+        FlushOutput ();         /* the output so far has been checked */
+        holdingOutput = TRUE;
+        SaveCheckpoint (&checkpoint);
+        if (!CheckInterval (&checkpoint, lockstepInterval, FALSE, &fast)) {
+            holdingOutput = FALSE;
+            Bisect (&checkpoint, fast.retired - checkpoint.retired);
+        }
+        if (fast.ended) {
+            holdingOutput = FALSE;
+            exit (fast.status);
         }
+    }
+}
 
-        /* Fetch instr at mips.pc, returning it in instr */
-        instr = Fetch (mips.pc);
+/*
+ *  Run with several harts, numbered 0 up. Set the number of harts, the
+ *  instructions each runs per turn and whether turns are taken in a
+ *  fixed order (deterministic) or harts run concurrently.
+ */
+void SetHarts (int n, int quantum, int deterministic) {
+    numHarts = n < 1 ? 1 : (n > MAXHARTS ? MAXHARTS : n);
+    hartQuantum = quantum < 1 ? 1 : quantum;
+    deterministicHarts = deterministic;
+}
 
-        printf ("Executing instruction at %8.8x: %8.8x\n", mips.pc, instr);
+/* Pass the turn to the next hart that hasn't finished. */
+static void NextTurn () {
+    int k;
+    for (k=1; k<=numHarts; k++) {
+        if (!hartDone[(currentHart+k) % numHarts]) {
+            currentHart = (currentHart+k) % numHarts;
+            break;
+        }
+    }
+    pthread_cond_broadcast (&hartTurn);
+}
 
-        /* 
-	 * Decode instr, putting decoded instr in d
-	 * Note that we reuse the d struct for each instruction.
-	 */
-        Decode (instr, &d, &rVals);
+/*
+ *  Thread body of one hart. It starts from bootState with its own
+ *  stack, below those of the lower numbered harts, and its number in
+ *  $k0.
+ */
+static void* RunHart (void* arg) {
+    int hart = (int)(long)arg;
 
-        /*Print decoded instruction*/
-        PrintInstruction(&d);
+    mips = bootState;
+    mips.hart = hart;
+    mips.pc = entryPoint;
+    mips.registers[26] = hart;
+    mips.registers[29] -= hart * HARTSTACK;
+    exitMode = EXIT_HART;
 
-        /* 
-	 * Perform computation needed to execute d, returning computed value 
-	 * in val 
-	 */
-        val = Execute(&d, &rVals); // val will have return value of temp in execute();
+    if (setjmp (runExit) == 0) {
+        if (deterministicHarts) {
+            while (1) {
+                pthread_mutex_lock (&hartLock);
+                while (currentHart != hart) {
+                    pthread_cond_wait (&hartTurn, &hartLock);
+                }
+                pthread_mutex_unlock (&hartLock);
+                Run (hartQuantum);
+                pthread_mutex_lock (&hartLock);
+                NextTurn ();
+                pthread_mutex_unlock (&hartLock);
+            }
+        } else {
+            Run (0);
+        }
+    }
 
-	UpdatePC(&d,val);
+    /* the hart reached the end of the program */
+    pthread_mutex_lock (&hartLock);
+    hartDone[hart] = TRUE;
+    if (deterministicHarts) {
+        NextTurn ();
+    }
+    pthread_mutex_unlock (&hartLock);
+    return NULL;
+}
 
-        /* 
-	 * Perform memory load or store. Place the
-	 * address of any updated memory in *changedMem, 
-	 * otherwise put -1 in *changedMem. 
-	 * Return any memory value that is read, otherwise return -1.
-         */
-        val = Mem(&d, val, &changedMem);
+/*
+ *  Run the simulation.
+ */
+void Simulate () {
+    pthread_t threads[MAXHARTS];
+    int k;
+    
+    /* Initialize the PC to the program's entry point */
+    mips.pc = entryPoint;
 
-        /* 
-	 * Write back to register. If the instruction modified a register--
-	 * (including jal, which modifies $ra) --
-         * put the index of the modified register in *changedReg,
-         * otherwise put -1 in *changedReg.
-         */
-        RegWrite(&d, val, &changedReg);
+    if (engine == ENGINE_FAST || lockstepInterval != 0) {
+        Predecode ();
+    }
+    if (lockstepInterval != 0) {
+        Lockstep ();
+    }
+    if (numHarts > 1) {
+        bootState = mips;
+        currentHart = 0;
+        for (k=0; k<numHarts; k++) {
+            if (pthread_create (&threads[k], NULL, RunHart, (void*)(long)k) != 0) {
+                fprintf (stderr, "Can't start hart %d.\n", k);
+                exit (1);
+            }
+        }
+        for (k=0; k<numHarts; k++) {
+            pthread_join (threads[k], NULL);
+        }
+        return;
+    }
 
-        PrintInfo (changedReg, changedMem);
+    if (mips.interactive) {
+        Debugger ();
+    } else {
+        Run (0);
     }
 }
 
@@ -138,7 +1421,8 @@ void Simulate () {
  */
 
 void PrintInfo ( int changedReg, int changedMem) {
-    int k, addr;
+    int k, addr, i, j;
+    unsigned int summary, bits;
     printf ("New pc = %8.8x\n", mips.pc);
     if (!mips.printingRegisters && changedReg == -1) {
         printf ("No register was updated.\n");
@@ -161,11 +1445,14 @@ void PrintInfo ( int changedReg, int changedMem) {
     } else {
         printf ("Nonzero memory\n");
         printf ("ADDR	  CONTENTS\n");
-        for (addr = 0x00400000+4*MAXNUMINSTRS;
-             addr < 0x00400000+4*(MAXNUMINSTRS+MAXNUMDATA);
-             addr = addr+4) {
-            if (Fetch (addr) != 0) {
-                printf ("%8.8x  %8.8x\n", addr, Fetch (addr));
+        /* visit the set bits of the nonzero index in address order */
+        for (i = 0; i < (DATABITWORDS+31)/32; i++) {
+            for (summary = nonzeroSummary[i]; summary != 0; summary &= summary-1) {
+                j = 32*i + __builtin_ctz(summary);
+                for (bits = nonzeroData[j]; bits != 0; bits &= bits-1) {
+                    addr = 0x00400000 + 4*(MAXNUMINSTRS + 32*j + __builtin_ctz(bits));
+                    printf ("%8.8x  %8.8x\n", addr, Fetch (addr));
+                }
             }
         }
     }
@@ -176,10 +1463,10 @@ void PrintInfo ( int changedReg, int changedMem) {
  *  instruction fetch. 
  */
 unsigned int Fetch ( int addr) {
-    return mips.memory[(addr-0x00400000)/4];
+    return LoadWord(addr);
 }
 
-void r_decode(unsigned int instr, DecodedInstr* d, RegVals* rVals){
+void r_decode(unsigned int instr, DecodedInstr* d){
     int r_rs, r_rt, r_rd, r_shamt, r_funct;
     //get funct
     r_funct = instr & 0x3f;
@@ -205,12 +1492,8 @@ void r_decode(unsigned int instr, DecodedInstr* d, RegVals* rVals){
     r_rs = instr & 0x1f;
     (*d).regs.r.rs = r_rs;
     //printf("R, rs is: %d\n", (*d).regs.r.rs);
-    //write to register values
-    (*rVals).R_rs = mips.registers[(*d).regs.r.rs]; //put the values of rs_register into Rvals_rs
-    (*rVals).R_rt = mips.registers[(*d).regs.r.rt]; //put the values of rt_register into Rvals_rt
-    (*rVals).R_rd = mips.registers[(*d).regs.r.rd]; //put the values of rd_register into Rvals_rd
 }
-void i_decode(unsigned int instr, DecodedInstr* d, RegVals* rVals){
+void i_decode(unsigned int instr, DecodedInstr* d){
     int temp, i_rs, i_rt, i_addr_or_immed, temp2;
     //get rs.
     temp = instr >> 21;
@@ -234,28 +1517,28 @@ void i_decode(unsigned int instr, DecodedInstr* d, RegVals* rVals){
                 d->regs.i.addr_or_immed = i_addr_or_immed | 0x00000000;
             }
     //printf("I, addr or immed is: %d\n", (*d).regs.i.addr_or_immed);
-    //write to register values
-    (*rVals).R_rs = mips.registers[(*d).regs.i.rs]; //put the values of rs_register into Rvals_rs
-    (*rVals).R_rt = mips.registers[(*d).regs.i.rt]; //put the values of rt_register into Rvals_rt
 }
-void j_decode(unsigned int instr, DecodedInstr* d, RegVals* rVals){
+void j_decode(unsigned int instr, int pc, DecodedInstr* d){
     //get target
     int temp;
     (*d).regs.j.target = instr & 0x3ffffff;
     (*d).regs.j.target = (*d).regs.j.target << 2; // add two left bits to make 28 bit
-    temp = mips.pc & 0xf0000000; // take first 4 bits from pc
+    temp = pc & 0xf0000000; // take first 4 bits from pc
     (*d).regs.j.target = (*d).regs.j.target + temp; // add the 4 bits froom pc to the target address, which will become 32-bit
     //printf("J, target is: %d\n", (*d).regs.j.target);
 
 }
 
-/* Decode instr, returning decoded instruction. */
-void Decode ( unsigned int instr, DecodedInstr* d, RegVals* rVals) {
-    /* Your code goes here */
+/*
+ *  Fill in the fields of d for the instruction instr located at pc.
+ *  Return FALSE if instr is not an instruction we simulate (including
+ *  the all-zero word that ends a program), TRUE otherwise.
+ */
+int DecodeFields ( unsigned int instr, int pc, DecodedInstr* d) {
     int opcode;
     if(instr == 0) // if there is no instruction, terminate
     {
-        exit(0);
+        return FALSE;
     }
     (*d).op = instr >> 26; //shift right 26 times, to get the first 6 binary of opcode.
     opcode = (*d).op; //opcode variable now has the opcode of a given instruction.
@@ -266,57 +1549,91 @@ void Decode ( unsigned int instr, DecodedInstr* d, RegVals* rVals) {
     // VVVVVVVV I - FORMAT VVVVVVVV
         case 9: // addiu 
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
         break;
         case 12: // andi
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
         break;
         case 13: // ori
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
         break;
         case 15: // lui
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
         break;
         case 4: // beq
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
         break;
         case 5: // bne
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
         break;
         case 35: // lw
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
         break;
         case 43: // sw
             (*d).type = I; 
-            i_decode(instr, d, rVals);
+            i_decode(instr, d);
+        break;
+        case 48: // ll
+            (*d).type = I; 
+            i_decode(instr, d);
+        break;
+        case 56: // sc
+            (*d).type = I; 
+            i_decode(instr, d);
         break;
 
     // VVVVVVVV R - FORMAT VVVVVVVV
         case 0: 
             (*d).type = R; 
-            r_decode(instr, d, rVals);
+            r_decode(instr, d);
         break; 
 
     // VVVVVVVV J - FORMAT VVVVVVVV
         case 2: //j
             (*d).type = J; 
-            j_decode(instr, d, rVals);
+            j_decode(instr, pc, d);
         break;
         case 3: // jal
             (*d).type = J; 
-            j_decode(instr, d, rVals);
+            j_decode(instr, pc, d);
         break;
         default:
-            exit(0);
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Read the register operands named by d into rVals. */
+static void ReadOperands ( DecodedInstr* d, RegVals* rVals) {
+    switch ((*d).type)
+    {
+        case R:
+            (*rVals).R_rs = mips.registers[(*d).regs.r.rs]; //put the values of rs_register into Rvals_rs
+            (*rVals).R_rt = mips.registers[(*d).regs.r.rt]; //put the values of rt_register into Rvals_rt
+            (*rVals).R_rd = mips.registers[(*d).regs.r.rd]; //put the values of rd_register into Rvals_rd
+        break;
+        case I:
+            (*rVals).R_rs = mips.registers[(*d).regs.i.rs];
+            (*rVals).R_rt = mips.registers[(*d).regs.i.rt];
+        break;
+        case J:
         break;
     }
 }
+
+/* Decode instr, returning decoded instruction. */
+void Decode ( unsigned int instr, DecodedInstr* d, RegVals* rVals) {
+    if (!DecodeFields(instr, mips.pc, d)) {
+        EndProgram ();
+    }
+    ReadOperands(d, rVals);
+}
 /*
  *  Print the disassembled version of the given instruction
  *  followed by a newline.
@@ -354,6 +1671,12 @@ void PrintInstruction ( DecodedInstr* d) {
         case 43: // sw
             printf("sw\t");
         break;
+        case 48: // ll
+            printf("ll\t");
+        break;
+        case 56: // sc
+            printf("sc\t");
+        break;
         case 0: switch((*d).regs.r.funct) // R-format
                 {
                     case 33: // addu
@@ -380,6 +1703,9 @@ void PrintInstruction ( DecodedInstr* d) {
                     case 8: // jr
                     printf("jr\t");
                     break;  
+                    case 12: // syscall
+                    printf("syscall");
+                    break;
                 }
     }
     // printing the register number and immed or address
@@ -403,6 +1729,10 @@ void PrintInstruction ( DecodedInstr* d) {
                 case 43:
                     printf("$%d, %d($%d)\n", (*d).regs.i.rt, (*d).regs.i.addr_or_immed, (*d).regs.i.rs);
                 break;
+                case 48:
+                case 56:
+                    printf("$%d, %d($%d)\n", (*d).regs.i.rt, (*d).regs.i.addr_or_immed, (*d).regs.i.rs);
+                break;
                 case 9:
                     printf("$%d, $%d, %d\n", (*d).regs.i.rt, (*d).regs.i.rs, (*d).regs.i.addr_or_immed);
                 break;
@@ -426,6 +1756,9 @@ void PrintInstruction ( DecodedInstr* d) {
                 case 8:
                     printf("$%d\n", (*d).regs.r.rs);
                 break;
+                case 12:
+                    printf("\n");
+                break;
                 case 33:
                     printf("$%d, $%d, $%d\n", (*d).regs.r.rd, (*d).regs.r.rs, (*d).regs.r.rt);
                 break;
@@ -509,6 +1842,9 @@ int Execute ( DecodedInstr* d, RegVals* rVals) {
                     temp = rVals->R_rs + d->regs.i.addr_or_immed;
                     //printf("execution output will be: %d\n", temp);
                     return temp; 
+                case 48: // ll
+                case 56: // sc
+                    return rVals->R_rs + d->regs.i.addr_or_immed;
                 
             }
         break;
@@ -606,6 +1942,305 @@ void UpdatePC ( DecodedInstr* d, int val) {
         break;
     }
 }
+/*
+ * Stop the program because the load or store just executed accessed
+ * addr, which is outside the data segment or not word aligned.
+ */
+static void MemoryException (int addr) {
+    char message[100];
+    sprintf (message, "Memory Access Exception at 0x%8.8x: address 0x%8.8x",
+        mips.pc - 4, addr);
+    Trap (TRAP_MEMORY, mips.pc - 4, addr, 0, message);
+}
+
+/*
+ * Only free-running harts can touch memory at the same time; in
+ * deterministic mode the hart whose turn it is has it to itself.
+ */
+static void LockMemory () {
+    if (numHarts > 1 && !deterministicHarts) {
+        pthread_mutex_lock (&memoryLock);
+    }
+}
+
+static void UnlockMemory () {
+    if (numHarts > 1 && !deterministicHarts) {
+        pthread_mutex_unlock (&memoryLock);
+    }
+}
+
+/*
+ * Is addr a word of the loaded data segments, or of the heap that sbrk
+ * has handed out so far?
+ */
+static int IsArenaWord (int addr) {
+    unsigned int a = addr;
+    return ((a >= DATABASE && a < dataBreak) || (a >= HEAPBASE && a < heapBreak))
+        && addr % 4 == 0;
+}
+
+/*
+ * The check lw and sw have always made, plus the data segments and the
+ * heap.
+ */
+static int BadAddress (int addr) {
+    return !IsArenaWord(addr)
+        && (addr < 0x00401000 || addr > 0x00404004 || addr % 4 != 0);
+}
+
+/*
+ * Return the arena word at addr, taking its page into use if allocate
+ * is set. Without allocate, a page never stored to gives NULL.
+ */
+static int* ArenaWord (int addr, int allocate) {
+    unsigned int k = ((unsigned int)addr - DATABASE) / 4;
+    int** page = &arenaPage[k / PAGEWORDS];
+    if (*page == NULL) {
+        if (!allocate) {
+            return NULL;
+        }
+        *page = arena + (k / PAGEWORDS) * PAGEWORDS;
+    }
+    return &(*page)[k % PAGEWORDS];
+}
+
+/* Return arena page k to reading as zero. */
+static void FreeArenaPage (int k) {
+    if (arenaPage[k] != NULL) {
+        memset (arenaPage[k], 0, PAGEWORDS*sizeof(int));
+        arenaPage[k] = NULL;
+    }
+}
+
+/* Return the word at addr, which is in memory or in the arena. */
+static int LoadWord (int addr) {
+    int* p;
+    if (IsArenaWord(addr)) {
+        p = ArenaWord(addr, FALSE);
+        return p == NULL ? 0 : *p;
+    }
+    return mips.memory[(addr-0x00400000)/4];
+}
+
+/* Store value at index k of mips.memory, keeping its indexes current. */
+static void StoreDataWord (int k, int value) {
+    if (mips.memory[k] != value) {
+        memGeneration++; // memory changed, so earlier states can't repeat
+    }
+    mips.memory[k] = value;
+    IndexDataWord(k);
+}
+
+/*
+ * Store value at address addr, which is known to be valid. Any ll
+ * reservation of the word is lost.
+ */
+static void StoreWord (int addr, int value) {
+    int h;
+    if (IsArenaWord(addr)) {
+        if (*ArenaWord(addr, TRUE) != value) {
+            memGeneration++;
+        }
+        *ArenaWord(addr, TRUE) = value;
+    } else {
+        StoreDataWord((addr-0x00400000)/4, value);
+    }
+    for (h=0; h<numHarts; h++) {
+        if (reservation[h].addr == addr) {
+            reservation[h].valid = FALSE;
+        }
+    }
+}
+
+/* Free the data segments and the heap, leaving both empty. */
+static void ResetArena () {
+    int k;
+    for (k=0; k<ARENAPAGES; k++) {
+        FreeArenaPage (k);
+    }
+    dataBreak = DATABASE;
+    heapBreak = HEAPBASE;
+}
+
+/*
+ * For the loader: return the host word to load the word at addr of a
+ * program into, taking its arena page into use, or NULL if addr is
+ * neither in memory nor below the heap in the arena.
+ */
+int* ProgramWord (unsigned int addr) {
+    if (addr % 4 != 0) {
+        return NULL;
+    } else if (addr >= 0x00400000 && addr < 0x00400000 + 4*(MAXNUMINSTRS+MAXNUMDATA)) {
+        return &guestMemory[(addr - 0x00400000) / 4];
+    } else if (addr >= DATABASE && addr < HEAPBASE) {
+        return ArenaWord (addr, TRUE);
+    }
+    return NULL;
+}
+
+/*
+ * Move the end of the heap by n bytes, rounded up to a word, and
+ * return the old end, or -1 if the heap would leave its bounds.
+ */
+static int Sbrk (int n) {
+    unsigned int old = heapBreak;
+    long long end = (long long)heapBreak + ((n + 3) & ~3);
+    if (end < HEAPBASE || end > HEAPBASE + 4LL*PAGEWORDS*HEAPPAGES) {
+        return -1;
+    }
+    heapBreak = end;
+    return old;
+}
+
+/* Add n bytes to the program's console output. */
+static void PutOutput (const char* s, size_t n) {
+    if (capturingOutput && outputSize + n > captureLimit) {
+        outputLost = TRUE;
+        return;
+    }
+    if (outputSize + n > outputMax) {
+        outputMax = 2*(outputSize + n) > OUTPUTCHUNK ? 2*(outputSize + n) : OUTPUTCHUNK;
+        output = realloc (output, outputMax);
+        if (output == NULL) {
+            fprintf (stderr, "Out of memory for output.\n");
+            exit (1);
+        }
+    }
+    memcpy (output+outputSize, s, n);
+    outputSize += n;
+    if (outputSize >= OUTPUTCHUNK) {
+        FlushOutput ();
+    }
+}
+
+/*
+ * Write out the program's pending console output, after anything the
+ * simulator itself has printed.
+ */
+static void FlushOutput () {
+    size_t done = 0;
+    ssize_t n;
+    if (capturingOutput || holdingOutput || outputSize == 0) {
+        return;
+    }
+    fflush (stdout);
+    while (done < outputSize) {
+        n = write (1, output+done, outputSize-done);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    outputSize = 0;
+}
+
+/*
+ * For the server: keep up to limit bytes of the program's output
+ * rather than writing it, or write it again if limit is 0. TakeOutput()
+ * hands it over and empties it; it returns NULL if the program printed
+ * more than the limit.
+ */
+void CaptureOutput (size_t limit) {
+    capturingOutput = limit != 0;
+    captureLimit = limit;
+}
+
+const char* TakeOutput (size_t* size) {
+    int lost = outputLost;
+    *size = outputSize;
+    outputSize = 0;
+    outputLost = FALSE;
+    if (lost) {
+        return NULL;
+    }
+    return output != NULL ? output : "";
+}
+
+/*
+ * Return the next integer of input, or 0 if there is none. Under
+ * lockstep the values are logged, so that running again from a
+ * checkpoint reads the same ones.
+ */
+static int ReadInt () {
+    int value;
+    if (lockstepInterval == 0 || inputNext == inputLogged) {
+        if (scanf ("%d", &value) != 1) {
+            value = 0;
+        }
+        if (lockstepInterval == 0) {
+            return value;
+        }
+        if (inputLogged == inputLogMax) {
+            inputLogMax = inputLogMax == 0 ? 64 : 2*inputLogMax;
+            inputLog = realloc (inputLog, inputLogMax*sizeof(int));
+            if (inputLog == NULL) {
+                fprintf (stderr, "Out of memory for input.\n");
+                exit (1);
+            }
+        }
+        inputLog[inputLogged++] = value;
+    }
+    return inputLog[inputNext++];
+}
+
+/*
+ * Perform the syscall selected by $v0, with the SPIM numbering:
+ *   1 print_int $a0, 4 print_string at $a0, 5 read_int into $v0,
+ *   9 sbrk $a0 bytes (old end of heap in $v0), 10 exit.
+ * Others do nothing, as syscall always did. Return the new $v0 and
+ * set syscallSetsV0 if the call produces one.
+ */
+static int Syscall () {
+    char text[16];
+    int addr = mips.registers[4];
+    int value = 0;
+    char c;
+
+    syscallSetsV0 = FALSE;
+    switch (mips.registers[2]) {
+        case 1: // print_int
+            LockMemory();
+            PutOutput (text, sprintf (text, "%d", addr));
+            UnlockMemory();
+        break;
+        case 4: // print_string
+            LockMemory();
+            while (1) {
+                if (!IsArenaWord(addr & ~3) && ((unsigned int)addr < 0x00400000
+                    || (unsigned int)addr >= 0x00400000 + 4*(MAXNUMINSTRS+MAXNUMDATA))) {
+                    UnlockMemory();
+                    MemoryException(addr);
+                }
+                c = LoadWord(addr & ~3) >> (8 * (3 - (addr & 3)));  // big-endian bytes
+                if (c == '\0') {
+                    break;
+                }
+                PutOutput (&c, 1);
+                addr++;
+            }
+            UnlockMemory();
+        break;
+        case 5: // read_int
+            if (!capturingOutput) {
+                FlushOutput ();
+                value = ReadInt ();
+            }
+            memGeneration++; // input can break what looks like a loop
+            syscallSetsV0 = TRUE;
+        break;
+        case 9: // sbrk
+            LockMemory();
+            value = Sbrk(addr);
+            UnlockMemory();
+            syscallSetsV0 = TRUE;
+        break;
+        case 10: // exit
+            EndProgram ();
+        break;
+    }
+    return value;
+}
+
 /*
  * Perform memory load or store. Place the address of any updated memory 
  * in *changedMem, otherwise put -1 in *changedMem. Return any memory value 
@@ -622,27 +2257,61 @@ int Mem( DecodedInstr* d, int val, int *changedMem) {
     switch(d->op)
     {
         case 35: // lw
-            if(val < 0x00401000 || val > 0x00404004 || val % 4 != 0){
-                printf("Memory Access Exception at 0x%8.8x: address 0x%8.8x\n", mips.pc - 4, val);
-                exit(0);
+            if(BadAddress(val)){
+                MemoryException(val);
             }
             else{
-                mips.registers[d->regs.i.rt] = mips.memory[(val-0x00400000)/4]; // load word from memory address to rt register, val will be the address.
+                mips.registers[d->regs.i.rt] = LoadWord(val); // load word from memory address to rt register, val will be the address.
                 *changedMem = -1;
                 val = mips.registers[d->regs.i.rt];
             }
         break;
         case 43: // sw
-            if(val < 0x00401000 || val > 0x00404004 || val % 4 != 0){ // check if the address is outside of data memory and if it is al
-                printf("Memory Access Exception at 0x%8.8x: address 0x%8.8x\n", mips.pc - 4, val);
-                exit(0);
+            if(BadAddress(val)){ // check if the address is outside of data memory and if it is al
+                MemoryException(val);
             }
             else{
-                mips.memory[(val-0x00400000)/4] = mips.registers[d->regs.i.rt]; // store word from rt register to memory address.
+                LockMemory();
+                StoreWord(val, mips.registers[d->regs.i.rt]);
+                UnlockMemory();
                 *changedMem = val;
                 val = -1;
             }
         break;
+        case 48: // ll
+            if(BadAddress(val)){
+                MemoryException(val);
+            }
+            else{
+                LockMemory();
+                reservation[mips.hart].addr = val; // watch the word until the sc
+                reservation[mips.hart].valid = TRUE;
+                val = LoadWord(val);
+                UnlockMemory();
+            }
+        break;
+        case 56: // sc
+            if(BadAddress(val)){
+                MemoryException(val);
+            }
+            else{
+                LockMemory();
+                if (reservation[mips.hart].valid && reservation[mips.hart].addr == val) {
+                    StoreWord(val, mips.registers[d->regs.i.rt]);
+                    *changedMem = val;
+                    val = 1; // rt gets 1 on success
+                } else {
+                    val = 0; // someone stored to the word since the ll
+                }
+                reservation[mips.hart].valid = FALSE;
+                UnlockMemory();
+            }
+        break;
+        case 0:
+            if (d->regs.r.funct == 12) { // syscall
+                val = Syscall();
+            }
+        break;
     }
   return val;
 }
@@ -665,6 +2334,11 @@ void RegWrite( DecodedInstr* d, int val, int *changedReg) {
                     mips.registers[d->regs.i.rt] = val;
                     *changedReg = d->regs.i.rt;
 				break;
+            	case 48: // ll
+            	case 56: // sc
+                    mips.registers[d->regs.i.rt] = val;
+                    *changedReg = d->regs.i.rt;
+				break;
             	case 15: // lui
                     mips.registers[d->regs.i.rt] = val;
                     *changedReg = d->regs.i.rt;
@@ -723,6 +2397,12 @@ void RegWrite( DecodedInstr* d, int val, int *changedReg) {
                     mips.registers[d->regs.r.rd] = val;
                     *changedReg = d->regs.r.rd;
                 break;
+                case 12: // syscall
+                    if (syscallSetsV0) {
+                        mips.registers[2] = val;
+                        *changedReg = 2;
+                    }
+                break;
             }
         break; 
     }
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+#  Simulated MIPS (millions of instructions per second) of each engine
+#  on a fixed set of generated workloads. Every run executes exactly
+#  the given number of instructions (default 20 million): the programs
+#  loop forever and sim stops them with -n.
+#
+#  Usage: bench.sh [instructions]
+
+N=${1:-20000000}
+DUMP=${TMPDIR:-/tmp}/bench$$.dump
+trap 'rm -f $DUMP' EXIT
+
+printf "%-10s %10s %10s\n" workload fast reference
+while read name options; do
+    ./gen -i $options $DUMP || exit 1
+    printf "%-10s" $name
+    for engine in "" "-x"; do
+        start=`date +%s%N`
+        ./sim $engine -e null -n $N $DUMP
+        if [ $? -ne 4 ]; then
+            echo " sim didn't run to the budget" >&2
+            exit 1
+        fi
+        end=`date +%s%N`
+        awk "BEGIN { printf \" %10.1f\", $N * 1000 / ($end - $start) }"
+    done
+    echo
+done <<WORKLOADS
+default   -s 1
+alu       -s 2 -m alu=60,imm=30,shift=10,load=0,store=0 -b 0 -l 1
+memory    -s 3 -m alu=30,imm=10,shift=0,load=40,store=20 -f 8192 -S 68
+branchy   -s 4 -b 40
+nested    -s 5 -l 5 -t 4 -n 100
+large     -s 6 -n 900 -l 1 -t 100
+WORKLOADS
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#include "cfg.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define TEXTBASE 0x00400000
+
+static DecodedInstr decoded[MAXNUMINSTRS];
+static int valid[MAXNUMINSTRS];
+static char leader[MAXNUMINSTRS+1];
+
+/*
+ *  Return the word index that the branch or jump d at word k
+ *  transfers to, or -1 if it leaves the analysed text.
+ */
+static int TargetWord (ControlFlowGraph* g, DecodedInstr* d, int k) {
+    int t;
+    if (d->type == J) {
+        t = (d->regs.j.target - TEXTBASE) / 4;
+    } else {
+        t = k + 1 + d->regs.i.addr_or_immed;
+    }
+    return (t >= 0 && t < g->numWords) ? t : -1;
+}
+
+static int IsBranch (DecodedInstr* d) {
+    return d->type == I && (d->op == 4 || d->op == 5);
+}
+
+static int IsJr (DecodedInstr* d) {
+    return d->type == R && d->regs.r.funct == 8;
+}
+
+static void AddEdge (ControlFlowGraph* g, int from, int to, EdgeKind kind) {
+    if (to == NOBLOCK) {
+        return;
+    }
+    if (g->numEdges == g->maxEdges) {
+        g->maxEdges = g->maxEdges ? 2*g->maxEdges : 2*MAXNUMINSTRS;
+        g->edge = realloc(g->edge, g->maxEdges * sizeof(CFGEdge));
+        if (g->edge == NULL) {
+            fprintf (stderr, "Out of memory building CFG.\n");
+            exit (1);
+        }
+    }
+    g->edge[g->numEdges].from = from;
+    g->edge[g->numEdges].to = to;
+    g->edge[g->numEdges].kind = kind;
+    g->edge[g->numEdges].back = FALSE;
+    g->numEdges++;
+}
+
+/* Block containing word k, or NOBLOCK if k is outside the text. */
+static int BlockAt (ControlFlowGraph* g, int k) {
+    return (k >= 0 && k < g->numWords) ? g->blockOf[k] : NOBLOCK;
+}
+
+/*
+ *  Find the leaders, cut the text into blocks and add the edges
+ *  leaving each block.
+ */
+static void FindBlocks (ControlFlowGraph* g, int* text, int entryWord) {
+    int k, b, t, last;
+    DecodedInstr* d;
+
+    memset (leader, 0, sizeof(leader));
+    leader[0] = TRUE;
+    leader[entryWord] = TRUE;
+    for (k=0; k<g->numWords; k++) {
+        valid[k] = DecodeFields(text[k], TEXTBASE+4*k, &decoded[k]);
+        d = &decoded[k];
+        if (!valid[k] || IsJr(d)) {
+            leader[k+1] = TRUE;
+        } else if (IsBranch(d) || d->type == J) {
+            leader[k+1] = TRUE;
+            if ((t = TargetWord(g, d, k)) >= 0) {
+                leader[t] = TRUE;
+            }
+        }
+    }
+
+    g->numBlocks = 0;
+    for (k=0; k<g->numWords; k++) {
+        if (leader[k]) {
+            b = g->numBlocks++;
+            g->block[b].start = k;
+            g->block[b].idom = NOBLOCK;
+            g->block[b].loopDepth = 0;
+        }
+        g->blockOf[k] = g->numBlocks-1;
+        g->block[g->numBlocks-1].end = k+1;
+    }
+
+    for (b=0; b<g->numBlocks; b++) {
+        last = g->block[b].end-1;
+        d = &decoded[last];
+        if (!valid[last]) {
+            continue;           /* the program ends here */
+        }
+        if (IsBranch(d)) {
+            t = BlockAt(g, TargetWord(g, d, last));
+            if (d->regs.i.rs == d->regs.i.rt) {
+                /* beq $x,$x always branches; bne $x,$x never does */
+                AddEdge (g, b, d->op == 4 ? t : BlockAt(g, last+1),
+                    d->op == 4 ? EDGE_TAKEN : EDGE_FALLTHROUGH);
+            } else {
+                AddEdge (g, b, t, EDGE_TAKEN);
+                AddEdge (g, b, BlockAt(g, last+1), EDGE_FALLTHROUGH);
+            }
+        } else if (d->type == J) {
+            AddEdge (g, b, BlockAt(g, TargetWord(g, d, last)),
+                d->op == 3 ? EDGE_CALL : EDGE_TAKEN);
+            if (d->op == 3) {
+                /* the callee returns to the next word */
+                AddEdge (g, b, BlockAt(g, last+1), EDGE_FALLTHROUGH);
+            }
+        } else if (IsJr(d)) {
+            for (k=0; k<g->numWords; k++) {
+                if (d->regs.r.rs == 31
+                    ? (k > 0 && valid[k-1] && decoded[k-1].type == J
+                       && decoded[k-1].op == 3)
+                    : leader[k]) {
+                    AddEdge (g, b, g->blockOf[k], EDGE_INDIRECT);
+                }
+            }
+        } else {
+            AddEdge (g, b, BlockAt(g, last+1), EDGE_FALLTHROUGH);
+        }
+    }
+}
+
+/*
+ *  Compute immediate dominators with the iterative algorithm of
+ *  Cooper, Harvey and Kennedy over a reverse postorder of the blocks
+ *  reachable from the root.
+ */
+static void FindDominators (ControlFlowGraph* g, int* predStart, int* pred,
+    int* succStart, int* succ) {
+    static int rpo[MAXNUMINSTRS], order[MAXNUMINSTRS];
+    static int stack[MAXNUMINSTRS], next[MAXNUMINSTRS];
+    int n = g->numBlocks, count = 0, top = 0, root = g->root;
+    int b, p, i, a, c, newIdom, changed;
+
+    for (b=0; b<n; b++) {
+        order[b] = -1;
+        next[b] = succStart[b];
+    }
+    /* iterative depth-first search, numbering blocks in postorder */
+    stack[top++] = root;
+    order[root] = 0;
+    while (top > 0) {
+        b = stack[top-1];
+        if (next[b] < succStart[b+1]) {
+            c = succ[next[b]++];
+            if (order[c] < 0) {
+                order[c] = 0;
+                stack[top++] = c;
+            }
+        } else {
+            rpo[count++] = b;
+            top--;
+        }
+    }
+    /* reverse the postorder in place and number the blocks */
+    for (i=0; i<count/2; i++) {
+        b = rpo[i];
+        rpo[i] = rpo[count-1-i];
+        rpo[count-1-i] = b;
+    }
+    for (i=0; i<count; i++) {
+        order[rpo[i]] = i;
+    }
+
+    g->block[root].idom = root;
+    do {
+        changed = FALSE;
+        for (i=1; i<count; i++) {
+            b = rpo[i];
+            newIdom = NOBLOCK;
+            for (p=predStart[b]; p<predStart[b+1]; p++) {
+                a = pred[p];
+                if (g->block[a].idom == NOBLOCK) {
+                    continue;
+                }
+                if (newIdom == NOBLOCK) {
+                    newIdom = a;
+                    continue;
+                }
+                c = newIdom;
+                while (a != c) {
+                    while (order[a] > order[c]) {
+                        a = g->block[a].idom;
+                    }
+                    while (order[c] > order[a]) {
+                        c = g->block[c].idom;
+                    }
+                }
+                newIdom = a;
+            }
+            if (g->block[b].idom != newIdom) {
+                g->block[b].idom = newIdom;
+                changed = TRUE;
+            }
+        }
+    } while (changed);
+    g->block[root].idom = NOBLOCK;
+}
+
+/*
+ *  Return TRUE if block a dominates block b. Every block dominates
+ *  itself; unreachable blocks are dominated by nothing else.
+ */
+int Dominates (ControlFlowGraph* g, int a, int b) {
+    while (b != NOBLOCK) {
+        if (a == b) {
+            return TRUE;
+        }
+        b = g->block[b].idom;
+    }
+    return FALSE;
+}
+
+int InLoop (NaturalLoop* l, int block) {
+    return (l->body[block/32] >> (block%32)) & 1;
+}
+
+/*
+ *  Mark the back edges and collect the natural loop of each header:
+ *  the header plus every block that reaches a back edge source
+ *  without passing through the header. jr edges are guesses, so they
+ *  are never back edges.
+ */
+static void FindLoops (ControlFlowGraph* g, int* predStart, int* pred) {
+    static int work[MAXNUMINSTRS];
+    int e, h, l, b, p, top;
+    NaturalLoop* loop;
+
+    g->numLoops = 0;
+    for (e=0; e<g->numEdges; e++) {
+        h = g->edge[e].to;
+        if (g->edge[e].kind == EDGE_INDIRECT || !Dominates(g, h, g->edge[e].from)) {
+            continue;
+        }
+        g->edge[e].back = TRUE;
+        for (l=0; l<g->numLoops && g->loop[l].header != h; l++)
+            ;
+        loop = &g->loop[l];
+        if (l == g->numLoops) {
+            g->numLoops++;
+            loop->header = h;
+            memset (loop->body, 0, sizeof(loop->body));
+            loop->body[h/32] |= 1u << (h%32);
+        }
+        top = 0;
+        b = g->edge[e].from;
+        if (!InLoop(loop, b)) {
+            loop->body[b/32] |= 1u << (b%32);
+            work[top++] = b;
+        }
+        while (top > 0) {
+            b = work[--top];
+            for (p=predStart[b]; p<predStart[b+1]; p++) {
+                if (!InLoop(loop, pred[p]) && Dominates(g, g->root, pred[p])) {
+                    loop->body[pred[p]/32] |= 1u << (pred[p]%32);
+                    work[top++] = pred[p];
+                }
+            }
+        }
+    }
+    for (l=0; l<g->numLoops; l++) {
+        for (b=0; b<g->numBlocks; b++) {
+            if (InLoop(&g->loop[l], b)) {
+                g->block[b].loopDepth++;
+            }
+        }
+    }
+}
+
+/*
+ *  Build the CFG of the first numWords words of text, which hold the
+ *  program loaded at 0x00400000 and entered at address entry.
+ */
+void BuildCFG (ControlFlowGraph* g, int* text, int numWords, int entry) {
+    static int predStart[MAXNUMINSTRS+1], succStart[MAXNUMINSTRS+1];
+    int *pred, *succ;
+    int b, e;
+
+    g->numWords = numWords > MAXNUMINSTRS ? MAXNUMINSTRS : numWords;
+    g->numEdges = 0;
+    g->numBlocks = 0;
+    g->numLoops = 0;
+    g->root = 0;
+    if (g->numWords == 0) {
+        return;
+    }
+    /* an entry outside the text leaves nothing to root the graph at but its start */
+    entry = (entry - TEXTBASE) / 4;
+    if (entry < 0 || entry >= g->numWords) {
+        entry = 0;
+    }
+    FindBlocks (g, text, entry);
+    g->root = g->blockOf[entry];
+
+    /* predecessor and successor lists, indexed by block */
+    pred = malloc((g->numEdges+1) * sizeof(int));
+    succ = malloc((g->numEdges+1) * sizeof(int));
+    if (pred == NULL || succ == NULL) {
+        fprintf (stderr, "Out of memory building CFG.\n");
+        exit (1);
+    }
+    memset (predStart, 0, sizeof(predStart));
+    memset (succStart, 0, sizeof(succStart));
+    for (e=0; e<g->numEdges; e++) {
+        predStart[g->edge[e].to+1]++;
+        succStart[g->edge[e].from+1]++;
+    }
+    for (b=0; b<g->numBlocks; b++) {
+        predStart[b+1] += predStart[b];
+        succStart[b+1] += succStart[b];
+    }
+    for (e=0; e<g->numEdges; e++) {
+        pred[predStart[g->edge[e].to]++] = g->edge[e].from;
+        succ[succStart[g->edge[e].from]++] = g->edge[e].to;
+    }
+    for (b=g->numBlocks; b>0; b--) {
+        predStart[b] = predStart[b-1];
+        succStart[b] = succStart[b-1];
+    }
+    predStart[0] = succStart[0] = 0;
+
+    FindDominators (g, predStart, pred, succStart, succ);
+    FindLoops (g, predStart, pred);
+    free (pred);
+    free (succ);
+}
+
+/* Return TRUE if a block starts at the given word of text. */
+int IsLeader (ControlFlowGraph* g, int word) {
+    return word >= 0 && word < g->numWords
+        && g->block[g->blockOf[word]].start == word;
+}
+
+/*
+ *  Write the CFG in Graphviz DOT form. Loop headers are drawn with a
+ *  double border, back edges in bold and jr edges dashed; each block
+ *  is labelled with its address range, immediate dominator and loop
+ *  depth.
+ */
+void PrintCFGDot (ControlFlowGraph* g, FILE* out) {
+    static const char* style[] = { "solid", "solid", "solid", "dashed" };
+    int b, e, l, header;
+
+    fprintf (out, "digraph cfg {\n");
+    fprintf (out, "    node [shape=box, fontname=\"monospace\"];\n");
+    for (b=0; b<g->numBlocks; b++) {
+        header = FALSE;
+        for (l=0; l<g->numLoops; l++) {
+            header |= g->loop[l].header == b;
+        }
+        fprintf (out, "    B%d [label=\"B%d\\n%8.8x-%8.8x", b, b,
+            TEXTBASE + 4*g->block[b].start, TEXTBASE + 4*g->block[b].end - 4);
+        if (g->block[b].idom != NOBLOCK) {
+            fprintf (out, "\\nidom B%d", g->block[b].idom);
+        }
+        if (g->block[b].loopDepth > 0) {
+            fprintf (out, "\\nloop depth %d", g->block[b].loopDepth);
+        }
+        fprintf (out, "\"%s];\n", header ? ", peripheries=2" : "");
+    }
+    for (e=0; e<g->numEdges; e++) {
+        fprintf (out, "    B%d -> B%d [style=%s%s];\n", g->edge[e].from,
+            g->edge[e].to, g->edge[e].back ? "bold" : style[g->edge[e].kind],
+            g->edge[e].kind == EDGE_CALL ? ", label=\"call\"" : "");
+    }
+    fprintf (out, "}\n");
+}
@@ -0,0 +1,54 @@
+/*
+ *  Static control-flow graph of the text segment, built once after
+ *  the program is loaded. Blocks are numbered in address order and
+ *  block 0 always starts at 0x00400000. Dominators are computed from
+ *  the root, the block at the program's entry point.
+ *
+ *  jr is handled conservatively: a jr $ra block gets an edge to every
+ *  return site (the word after each jal), any other jr gets an edge
+ *  to every block. Extra edges can only hide dominators, never invent
+ *  them, but an edge to a block that dominates the jr would look like
+ *  a back edge, so jr edges never close a loop. A loop whose only way
+ *  back is a jr is not found.
+ */
+
+#define NOBLOCK -1
+#define SETWORDS ((MAXNUMINSTRS+31)/32)
+
+typedef enum { EDGE_FALLTHROUGH=0, EDGE_TAKEN, EDGE_CALL, EDGE_INDIRECT } EdgeKind;
+
+typedef struct {
+    int from, to;           /* block numbers */
+    EdgeKind kind;
+    int back;               /* nonzero if to dominates from */
+} CFGEdge;
+
+typedef struct {
+    int start, end;         /* word indices of the block, end exclusive */
+    int idom;               /* immediate dominator, NOBLOCK if none */
+    int loopDepth;          /* number of natural loops containing it */
+} BasicBlock;
+
+typedef struct {
+    int header;                     /* block the back edges enter */
+    unsigned int body[SETWORDS];    /* bit set of member blocks */
+} NaturalLoop;
+
+typedef struct {
+    int numWords;                   /* words of text analysed */
+    int numBlocks;
+    int root;                       /* block holding the entry point */
+    BasicBlock block[MAXNUMINSTRS];
+    int blockOf[MAXNUMINSTRS];      /* block of each word of text */
+    int numEdges, maxEdges;
+    CFGEdge* edge;                  /* grown with realloc as needed */
+    int numLoops;
+    NaturalLoop loop[MAXNUMINSTRS];
+} ControlFlowGraph;
+
+ControlFlowGraph* ProgramCFG ();
+void BuildCFG (ControlFlowGraph*, int* text, int numWords, int entry);
+int IsLeader (ControlFlowGraph*, int word);
+int Dominates (ControlFlowGraph*, int a, int b);
+int InLoop (NaturalLoop*, int block);
+void PrintCFGDot (ControlFlowGraph*, FILE*);
@@ -2,10 +2,20 @@
 #define MAXNUMINSTRS 1024	/* max # instrs in a program */
 #define MAXNUMDATA 3072		/* max # data words */
 
+/* ELF data linked at the usual addresses goes from DATABASE to the heap */
+#define DATABASE 0x10000000
+#define HEAPBASE 0x10040000
+
+/* Each hart's stack is cut from the top of the data words */
+#define HARTSTACK 1024		/* bytes of stack below each hart's $sp */
+#define MAXHARTS (4*MAXNUMDATA/HARTSTACK)
+
 struct SimulatedComputer {
-    int memory [MAXNUMINSTRS+MAXNUMDATA];
+    int* memory;        /* MAXNUMINSTRS+MAXNUMDATA words, shared by all harts */
     int registers [32];
     int pc;
+    int numInstrs;      /* words of program loaded into the text segment */
+    int hart;           /* number of this hart, 0 when there is only one */
     int printingRegisters, printingMemory, interactive, debugging;
 };
 typedef struct SimulatedComputer Computer;
@@ -46,6 +56,27 @@ typedef struct {
   int R_rd;
 } RegVals;
 
+typedef enum { ENGINE_FAST=0, ENGINE_REFERENCE } Engine;
+
+/* Exit statuses for programs stopped by the simulator */
+#define EXIT_LIVELOCK 3		/* the program entered an infinite loop */
+#define EXIT_BUDGET 4		/* the instruction budget ran out */
+#define EXIT_DIVERGED 5		/* lockstep engines disagreed */
+
 void InitComputer (FILE*, int printingRegisters, int printingMemory,
     int debugging, int interactive);
+int DecodeFields (unsigned int instr, int pc, DecodedInstr*);
+void SelectEngine (Engine);
+void SetInstructionBudget (long long);
+void SetHarts (int harts, int quantum, int deterministic);
+void SetLockstep (long long interval);
 void Simulate ();
+int RunToStop (long long n);
+int LoadProgram (const char* image, int bytes);
+int RunProgram (long long budget, int* trap, long long* count);
+int NextNonzeroWord (int);
+int* GuestWord (unsigned int addr);
+int* ProgramWord (unsigned int addr);
+int GuestAddress (const void* host, unsigned int* addr);
+void CaptureOutput (size_t limit);
+const char* TakeOutput (size_t* size);
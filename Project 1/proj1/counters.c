@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "counters.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAXCOUNTERS 64
+#define MAXTIMERS 64            /* threads that time steps */
+
+int countersActive = FALSE;
+volatile sig_atomic_t countersRequested = FALSE;
+__thread int timing = FALSE;
+
+/*
+ *  Each thread adds up its own phase times in phaseNs, so harts don't
+ *  share a cache line on every phase change. DumpCounters() sums those
+ *  of the threads still running and finishedNs, where a thread's times
+ *  go when it ends.
+ */
+static __thread long long phaseNs[NUMPHASES];
+static long long* timers[MAXTIMERS];
+static int numTimers = 0;
+static long long finishedNs[NUMPHASES];
+static pthread_mutex_t timersLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t timerKey;          /* set once a thread times a step */
+
+static const char* phaseNames[NUMPHASES] = {
+    "fetch", "decode", "execute", "memory", "writeback", "print"
+};
+
+static struct {
+    const char* name;
+    long long* value;
+} registry[MAXCOUNTERS];
+static int numCounters = 0;
+
+static FILE* countersOut;
+static long long clockCost;     /* time to read the clock, taken off every phase */
+static __thread int currentPhase;
+static __thread long long phaseStart;
+static __thread unsigned int stepsUntilTimed;
+
+/*
+ *  Add a counter, written under name. The module that owns it keeps
+ *  value up to date, only while countersActive if that costs anything.
+ */
+void RegisterCounter (const char* name, long long* value) {
+    if (numCounters == MAXCOUNTERS) {
+        fprintf (stderr, "Too many counters.\n");
+        exit (1);
+    }
+    registry[numCounters].name = name;
+    registry[numCounters].value = value;
+    numCounters++;
+}
+
+/* Write all the counters to countersOut as one line of JSON. */
+void DumpCounters () {
+    long long ns[NUMPHASES];
+    int k, t;
+    countersRequested = FALSE;
+    pthread_mutex_lock (&timersLock);
+    for (k=0; k<NUMPHASES; k++) {
+        ns[k] = finishedNs[k];
+        for (t=0; t<numTimers; t++) {
+            ns[k] += __atomic_load_n (&timers[t][k], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock (&timersLock);
+    fprintf (countersOut, "{");
+    for (k=0; k<numCounters; k++) {
+        fprintf (countersOut, "\"%s\":%lld,", registry[k].name, *registry[k].value);
+    }
+    fprintf (countersOut, "\"ns\":{");
+    for (k=0; k<NUMPHASES; k++) {
+        fprintf (countersOut, "%s\"%s\":%lld", k == 0 ? "" : ",", phaseNames[k], ns[k]);
+    }
+    fprintf (countersOut, "}}\n");
+    fflush (countersOut);
+}
+
+static long long Now () {
+    struct timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/*
+ *  Phases are short enough that reading the clock costs as much as
+ *  some of them take; measure the average cost.
+ */
+static void CalibrateClock () {
+    long long start = Now ();
+    int k;
+    for (k=0; k<1000; k++) {
+        Now ();
+    }
+    clockCost = (Now () - start) / 1001;
+}
+
+/* Add the calling thread's phase times to those DumpCounters() sums. */
+static void AddTimer () {
+    pthread_mutex_lock (&timersLock);
+    if (numTimers == MAXTIMERS) {
+        fprintf (stderr, "Too many threads timed.\n");
+        exit (1);
+    }
+    timers[numTimers++] = phaseNs;
+    pthread_mutex_unlock (&timersLock);
+    pthread_setspecific (timerKey, phaseNs);
+}
+
+/* A thread that timed steps is ending: keep its phase times. */
+static void RemoveTimer (void* ns) {
+    int k;
+    pthread_mutex_lock (&timersLock);
+    for (k=0; k<NUMPHASES; k++) {
+        finishedNs[k] += ((long long*)ns)[k];
+    }
+    for (k=0; timers[k] != ns; k++)
+        ;
+    timers[k] = timers[--numTimers];
+    pthread_mutex_unlock (&timersLock);
+}
+
+static void RequestCounters (int sig) {
+    countersRequested = TRUE;   /* the simulator dumps them after the current step */
+}
+
+/*
+ *  Start counting, writing the counters to the file at path ("-" for
+ *  standard error) when the simulator exits and on SIGUSR1.
+ */
+void EnableCounters (const char* path) {
+    struct sigaction action;
+
+    countersOut = strcmp (path, "-") == 0 ? stderr : fopen (path, "w");
+    if (countersOut == NULL) {
+        fprintf (stderr, "Can't open file: %s\n", path);
+        exit (1);
+    }
+    memset (&action, 0, sizeof(action));
+    action.sa_handler = RequestCounters;
+    action.sa_flags = SA_RESTART;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGUSR1, &action, NULL);
+    pthread_key_create (&timerKey, RemoveTimer);
+    atexit (DumpCounters);
+    countersActive = TRUE;
+    CalibrateClock ();
+}
+
+/* Decide whether to time the step that is starting. */
+void StartTiming () {
+    if (!countersActive || stepsUntilTimed-- != 0) {
+        return;
+    }
+    stepsUntilTimed = PHASESAMPLE - 1;
+    if (pthread_getspecific (timerKey) == NULL) {
+        AddTimer ();
+    }
+    timing = TRUE;
+    currentPhase = PH_FETCH;
+    phaseStart = Now ();
+}
+
+/* Switching to PH_NONE ends the timed step. */
+void EnterPhase (Phase p) {
+    long long now = Now ();
+    /* only this thread writes its times, but DumpCounters() may read them */
+    if (now - phaseStart > clockCost) {
+        __atomic_store_n (&phaseNs[currentPhase],
+            phaseNs[currentPhase] + PHASESAMPLE * (now - phaseStart - clockCost),
+            __ATOMIC_RELAXED);
+    }
+    phaseStart = now;
+    currentPhase = p;
+    if (p == PH_NONE) {
+        timing = FALSE;
+    }
+}
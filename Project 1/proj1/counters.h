@@ -0,0 +1,39 @@
+/*
+ *  Counters of what the simulator does and of where its own host time
+ *  goes, for comparing the simulator before and after an optimization.
+ *  Modules register named counters; when counting is on (sim -c) they
+ *  are written as one JSON object per line at exit and on SIGUSR1.
+ *
+ *  Host time is split into the phases of a step. Only one step in
+ *  PHASESAMPLE is timed, and its times are scaled up accordingly, so
+ *  that reading the clock costs little.
+ */
+
+#include <signal.h>
+
+typedef enum {
+    PH_FETCH = 0, PH_DECODE, PH_EXECUTE, PH_MEMORY, PH_WRITEBACK, PH_PRINT,
+    NUMPHASES, PH_NONE = NUMPHASES
+} Phase;
+
+#define PHASESAMPLE 16
+
+extern int countersActive;
+extern volatile sig_atomic_t countersRequested;     /* SIGUSR1 arrived */
+extern __thread int timing;             /* this step's phases are being timed */
+
+/* Begin a step, which may be timed; it starts in PH_FETCH. */
+#define START_TIMING() do { if (countersActive) StartTiming (); } while (0)
+
+/*
+ *  Charge the time since the last phase change to the current phase,
+ *  and switch to p. A step that stops early, by a trap or the end of
+ *  the program, must end with PHASE(PH_NONE) too.
+ */
+#define PHASE(p) do { if (timing) EnterPhase (p); } while (0)
+
+void RegisterCounter (const char* name, long long* value);
+void EnableCounters (const char* path);
+void DumpCounters ();
+void StartTiming ();
+void EnterPhase (Phase);
@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "computer.h"
+#include "events.h"
+#include "debug.h"
+
+#define TRUE 1
+#define FALSE 0
+
+extern __thread Computer mips;
+
+unsigned int breakBits[(MAXNUMINSTRS+31)/32];
+volatile sig_atomic_t watchFault = FALSE;
+int debugStop = FALSE;
+
+/* Watched ranges of guest addresses, each from start up to end. */
+#define MAXWATCHES 64
+static struct {
+    unsigned int start, end;
+} watch[MAXWATCHES];
+static int numWatches = 0;
+
+static size_t hostPage;         /* bytes in a host page */
+static unsigned int faultAddr;  /* word stored to by the faulting step */
+static int faultOld;            /* and its value before */
+static struct {
+    unsigned int addr;
+    int old, value, pc;
+} watchHit;                     /* the store that set debugStop */
+
+static const char* regNames[] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+/*
+ *  Breakpoint conditions are compiled from text such as
+ *  "$v0 == 6 && $t0 < $t1" into a list of comparisons, all of which
+ *  must hold. An operand is a register, the pc or a constant.
+ */
+#define MAXTERMS 4
+#define PCREG 32                /* operand register number for the pc */
+#define CONSTANT -1
+
+typedef enum { EQ=0, NE, LT, LE, GT, GE } Comparison;
+
+typedef struct {
+    int reg;                    /* register, PCREG or CONSTANT */
+    int value;                  /* the constant */
+} Operand;
+
+typedef struct {
+    int numTerms;
+    struct {
+        Operand a, b;
+        Comparison cmp;
+    } term[MAXTERMS];
+} Predicate;
+
+static Predicate* condition[MAXNUMINSTRS];     /* NULL if unconditional */
+
+static int OperandValue (Operand* o) {
+    if (o->reg == CONSTANT) {
+        return o->value;
+    }
+    return o->reg == PCREG ? mips.pc : mips.registers[o->reg];
+}
+
+static int Holds (Predicate* p) {
+    int k, a, b, holds = TRUE;
+    for (k=0; k<p->numTerms && holds; k++) {
+        a = OperandValue (&p->term[k].a);
+        b = OperandValue (&p->term[k].b);
+        switch (p->term[k].cmp) {
+            case EQ: holds = a == b; break;
+            case NE: holds = a != b; break;
+            case LT: holds = a < b; break;
+            case LE: holds = a <= b; break;
+            case GT: holds = a > b; break;
+            case GE: holds = a >= b; break;
+        }
+    }
+    return holds;
+}
+
+/* Skip blanks, returning the next character of interest. */
+static char* SkipBlanks (char* s) {
+    while (isspace ((unsigned char)*s)) {
+        s++;
+    }
+    return s;
+}
+
+/*
+ *  Parse a register name ("$v0", "$2", "pc") or a number at *s,
+ *  advancing *s past it. Return FALSE if there is neither.
+ */
+static int ParseOperand (char** s, Operand* o) {
+    char* p = SkipBlanks (*s);
+    char* end;
+    int k, len;
+
+    if (strncmp (p, "pc", 2) == 0 && !isalnum ((unsigned char)p[2])) {
+        o->reg = PCREG;
+        *s = p+2;
+        return TRUE;
+    }
+    if (*p == '$') {
+        p++;
+        if (isdigit ((unsigned char)*p)) {
+            k = strtol (p, &end, 10);
+            if (k < 0 || k > 31) {
+                return FALSE;
+            }
+            o->reg = k;
+            *s = end;
+            return TRUE;
+        }
+        for (k=0; k<32; k++) {
+            len = strlen (regNames[k]);
+            if (strncmp (p, regNames[k], len) == 0 && !isalnum ((unsigned char)p[len])) {
+                o->reg = k;
+                *s = p+len;
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+    o->reg = CONSTANT;
+    o->value = strtol (p, &end, 0);
+    if (end == p) {
+        return FALSE;
+    }
+    *s = end;
+    return TRUE;
+}
+
+/* Compile the condition s into a new predicate, or return NULL. */
+static Predicate* CompileCondition (char* s) {
+    static const char* ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+    static const Comparison cmps[] = { EQ, NE, LE, GE, LT, GT };
+    Predicate p;
+    Predicate* result;
+    int k;
+
+    p.numTerms = 0;
+    while (1) {
+        if (p.numTerms == MAXTERMS || !ParseOperand (&s, &p.term[p.numTerms].a)) {
+            return NULL;
+        }
+        s = SkipBlanks (s);
+        for (k=0; k<6; k++) {
+            if (strncmp (s, ops[k], strlen (ops[k])) == 0) {
+                break;
+            }
+        }
+        if (k == 6) {
+            return NULL;
+        }
+        s += strlen (ops[k]);
+        p.term[p.numTerms].cmp = cmps[k];
+        if (!ParseOperand (&s, &p.term[p.numTerms].b)) {
+            return NULL;
+        }
+        p.numTerms++;
+        s = SkipBlanks (s);
+        if (*s == '\0') {
+            break;
+        }
+        if (strncmp (s, "&&", 2) != 0) {
+            return NULL;
+        }
+        s += 2;
+    }
+    result = malloc (sizeof(Predicate));
+    *result = p;
+    return result;
+}
+
+/*
+ *  Called by the simulator when pc is on a breakpoint word: return
+ *  TRUE if the program should stop there.
+ */
+int BreakHere (int pc) {
+    int k = (pc - 0x00400000) / 4;
+    return condition[k] == NULL || Holds (condition[k]);
+}
+
+/* The host page holding the guest word at addr, which is backed. */
+static void* HostPage (unsigned int addr) {
+    return (void*)((size_t)GuestWord (addr & ~3) & ~(hostPage-1));
+}
+
+/*
+ *  SIGSEGV handler. A store to a protected page lands here before
+ *  taking effect: note the word and its value, and unprotect the page
+ *  so that the store goes through when the handler returns. Any other
+ *  fault is a real one, and happens again without the handler.
+ */
+static void WatchFault (int sig, siginfo_t* info, void* context) {
+    unsigned int addr;
+    if (watchFault || !GuestAddress (info->si_addr, &addr)) {
+        signal (SIGSEGV, SIG_DFL);
+        return;
+    }
+    faultAddr = addr & ~3;
+    faultOld = *GuestWord (faultAddr);
+    mprotect (HostPage (faultAddr), hostPage, PROT_READ|PROT_WRITE);
+    watchFault = TRUE;
+}
+
+/*
+ *  Called by the simulator after a step, starting at pc, that stored
+ *  to a watched page: stop if it changed a watched word, and protect
+ *  the page again.
+ */
+void FinishWatch (int pc) {
+    int value = *GuestWord (faultAddr);
+    int k;
+
+    watchFault = FALSE;
+    mprotect (HostPage (faultAddr), hostPage, PROT_READ);
+    for (k=0; k<numWatches && value != faultOld; k++) {
+        if (faultAddr >= watch[k].start && faultAddr < watch[k].end) {
+            watchHit.addr = faultAddr;
+            watchHit.old = faultOld;
+            watchHit.value = value;
+            watchHit.pc = pc;
+            debugStop = TRUE;
+            break;
+        }
+    }
+}
+
+/*
+ *  Watch the words from start up to end, all of which are backed by
+ *  the host, by write-protecting the pages under them.
+ */
+static void AddWatch (unsigned int start, unsigned int end) {
+    struct sigaction action;
+    unsigned int addr;
+
+    if (hostPage == 0) {
+        hostPage = sysconf (_SC_PAGESIZE);
+        memset (&action, 0, sizeof(action));
+        action.sa_sigaction = WatchFault;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset (&action.sa_mask);
+        sigaction (SIGSEGV, &action, NULL);
+    }
+    watch[numWatches].start = start;
+    watch[numWatches].end = end;
+    numWatches++;
+    /* guest segments start on host page boundaries */
+    for (addr = start & ~(hostPage-1); addr < end; addr += hostPage) {
+        if (GuestWord (addr < start ? start : addr) != NULL) {
+            mprotect (HostPage (addr < start ? start : addr), hostPage, PROT_READ);
+        }
+    }
+}
+
+static void SetBreak (int k, int on) {
+    if (on) {
+        breakBits[k>>5] |= 1u << (k&31);
+    } else {
+        breakBits[k>>5] &= ~(1u << (k&31));
+    }
+}
+
+/*
+ *  Parse a text address at *s and return its word index, or -1 if
+ *  it isn't a word of text.
+ */
+static int TextWord (char** s) {
+    char* end;
+    unsigned int addr = strtoul (*s, &end, 0);
+    if (end == *s || addr < 0x00400000 || addr % 4 != 0
+        || (addr - 0x00400000) / 4 >= MAXNUMINSTRS) {
+        return -1;
+    }
+    *s = end;
+    return (addr - 0x00400000) / 4;
+}
+
+/* Run n instructions, or to a stop if n is 0, with or without tracing. */
+static void Resume (long long n, int tracing) {
+    int saved = eventsActive;
+    int k;
+
+    eventsActive = tracing && saved;
+    k = RunToStop (n);
+    eventsActive = saved;
+    if (debugStop) {
+        printf ("Watchpoint at 0x%8.8x: 0x%8.8x changed to 0x%8.8x (pc 0x%8.8x)\n",
+            watchHit.addr, watchHit.old, watchHit.value, watchHit.pc);
+    } else if (k) {
+        printf ("Breakpoint at 0x%8.8x\n", mips.pc);
+    }
+}
+
+static void Help () {
+    printf ("Commands (an empty line steps one instruction):\n");
+    printf ("  step [N]             execute N instructions, tracing each\n");
+    printf ("  continue             run until a breakpoint or watchpoint\n");
+    printf ("  until ADDR           run until pc reaches ADDR\n");
+    printf ("  break ADDR [if COND] stop at ADDR, e.g. break 0x400010 if $v0 == 6\n");
+    printf ("  delete ADDR          remove the breakpoint at ADDR\n");
+    printf ("  watch ADDR [BYTES]   stop when a word of the BYTES (4) from ADDR changes\n");
+    printf ("  print $REG|pc|ADDR   show a register or a word of memory\n");
+    printf ("  quit\n");
+}
+
+/* Print a register, the pc or the memory word named by s. */
+static void Print (char* s) {
+    Operand o;
+    int* p;
+
+    if (!ParseOperand (&s, &o)) {
+        printf ("Can't print that.\n");
+    } else if (o.reg == PCREG) {
+        printf ("pc = 0x%8.8x\n", mips.pc);
+    } else if (o.reg != CONSTANT) {
+        printf ("$%d = 0x%8.8x (%d)\n", o.reg, mips.registers[o.reg],
+            mips.registers[o.reg]);
+    } else if ((p = GuestWord (o.value)) == NULL) {
+        printf ("0x%8.8x is not a word of memory.\n", o.value);
+    } else {
+        printf ("0x%8.8x: 0x%8.8x (%d)\n", o.value, *p, *p);
+    }
+}
+
+/*
+ *  Does the command word at s match name, abbreviated to at least its
+ *  first letter? Set *args to what follows it.
+ */
+static int Command (char* s, const char* name, char** args) {
+    int len = 0;
+    while (isalpha ((unsigned char)s[len])) {
+        len++;
+    }
+    if (len == 0 || strncmp (s, name, len) != 0) {
+        return FALSE;
+    }
+    *args = SkipBlanks (s+len);
+    return TRUE;
+}
+
+/*
+ *  Read and obey debugger commands until "quit" or the end of input.
+ *  The program itself may end first, which exits the simulator.
+ */
+void Debugger () {
+    char line[200];
+    char *s, *args, *cond;
+    int k;
+    long long n;
+    unsigned int start, bytes;
+
+    while (1) {
+        printf ("> ");
+        fflush (stdout);
+        if (fgets (line, sizeof(line), stdin) == NULL) {
+            return;
+        }
+        line[strcspn (line, "\n")] = '\0';
+        s = SkipBlanks (line);
+        if (*s == '\0') {
+            Resume (1, TRUE);
+        } else if (Command (s, "quit", &args)) {
+            return;
+        } else if (Command (s, "step", &args)) {
+            n = *args ? atoll (args) : 1;
+            if (n > 0) {
+                Resume (n, TRUE);
+            }
+        } else if (Command (s, "continue", &args)) {
+            Resume (0, FALSE);
+        } else if (Command (s, "until", &args)) {
+            if ((k = TextWord (&args)) < 0) {
+                printf ("until needs an address in the text segment.\n");
+            } else if (IsBreakWord (k)) {
+                Resume (0, FALSE);
+            } else {
+                /* a temporary breakpoint, reported as any other */
+                SetBreak (k, TRUE);
+                Resume (0, FALSE);
+                SetBreak (k, FALSE);
+            }
+        } else if (Command (s, "break", &args)) {
+            if ((k = TextWord (&args)) < 0) {
+                printf ("break needs an address in the text segment.\n");
+                continue;
+            }
+            cond = SkipBlanks (args);
+            free (condition[k]);
+            condition[k] = NULL;
+            if (strncmp (cond, "if", 2) == 0) {
+                condition[k] = CompileCondition (cond+2);
+                if (condition[k] == NULL) {
+                    printf ("Can't understand the condition \"%s\".\n", cond+2);
+                    continue;
+                }
+            } else if (*cond != '\0') {
+                printf ("Expected \"if\" after the address.\n");
+                continue;
+            }
+            SetBreak (k, TRUE);
+        } else if (Command (s, "delete", &args)) {
+            if ((k = TextWord (&args)) < 0) {
+                printf ("delete needs an address in the text segment.\n");
+                continue;
+            }
+            SetBreak (k, FALSE);
+            free (condition[k]);
+            condition[k] = NULL;
+        } else if (Command (s, "watch", &args)) {
+            start = strtoul (args, &args, 0);
+            bytes = *SkipBlanks (args) ? strtoul (args, NULL, 0) : 4;
+            if (start % 4 != 0 || bytes == 0 || start + bytes < start
+                || GuestWord (start) == NULL
+                || GuestWord ((start + bytes - 1) & ~3) == NULL) {
+                printf ("watch needs a word address and a length within memory, the data segments or the heap.\n");
+                continue;
+            }
+            if (numWatches == MAXWATCHES) {
+                printf ("Too many watchpoints.\n");
+                continue;
+            }
+            AddWatch (start, start + bytes);
+        } else if (Command (s, "print", &args)) {
+            Print (args);
+        } else {
+            Help ();
+        }
+    }
+}
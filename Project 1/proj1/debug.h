@@ -0,0 +1,21 @@
+/*
+ *  Interactive debugger (-i). Breakpoints are kept in a bitmap indexed
+ *  by text word, so the simulator tests one in O(1). Watchpoints
+ *  write-protect the host pages under the watched range; a store to
+ *  one of them faults and sets watchFault, and stores elsewhere cost
+ *  nothing. "continue" runs on the fast engine until something is hit.
+ */
+
+#include <signal.h>
+
+extern unsigned int breakBits[(MAXNUMINSTRS+31)/32];
+extern volatile sig_atomic_t watchFault;    /* a store hit a watched page */
+extern int debugStop;           /* a watchpoint was hit */
+
+/* Is there a breakpoint (possibly conditional) on text word k? */
+#define IsBreakWord(k) ((unsigned int)(k) < MAXNUMINSTRS \
+    && (breakBits[(k)>>5] >> ((k)&31) & 1))
+
+int BreakHere (int pc);
+void FinishWatch (int pc);
+void Debugger ();
@@ -0,0 +1,38 @@
+# ELF test case: the entry point, main, is not the first word of text,
+# and the program sums a table initialized in .data into a .bss word.
+# The data is linked right after the text, in the 12 KB of data memory
+# below 0x00404000; elfhigh.s links its data at 0x10010000 instead:
+#
+#   mips-linux-gnu-as elfdata.s -o elfdata.o
+#   mips-linux-gnu-ld -Ttext 0x00400000 -Tdata 0x00401000 -e main elfdata.o -o elfdata.elf
+#
+
+		.set	noreorder
+		.text
+Sum:					# $v0 = sum of the $a1 words at $a0
+		addiu	$v0,$0,0
+Loop:
+		beq	$a1,$0,Done
+		lw	$t0,0($a0)
+		addu	$v0,$v0,$t0
+		addiu	$a0,$a0,4
+		addiu	$a1,$a1,-1
+		j	Loop
+Done:
+		jr	$ra
+
+main:
+		lui	$a0,0x0040
+		ori	$a0,$a0,0x1000		# Table
+		addiu	$a1,$0,6
+		jal	Sum
+		lui	$t1,0x0040
+		ori	$t1,$t1,0x1018		# Total
+		sw	$v0,0($t1)
+		addi	$0,$0,0 #unsupported instruction, terminate
+
+		.data
+Table:		.word	3, 1, 4, 1, 5, 9
+
+		.bss
+Total:		.space	4
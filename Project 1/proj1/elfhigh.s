@@ -0,0 +1,30 @@
+# ELF test case: data linked at the usual MIPS address, 0x10010000,
+# with an initialized table bigger than the 12 KB of data memory above
+# the text. The program adds the table's first and last words into a
+# .bss word, reads that back, and reads the first word again through
+# $gp, which the loader sets to the start of the data + 0x7ff0.
+#
+#   mips-linux-gnu-as elfhigh.s -o elfhigh.o
+#   mips-linux-gnu-ld -Ttext 0x00400000 -Tdata 0x10010000 -e main elfhigh.o -o elfhigh.elf
+#
+
+		.set	noreorder
+		.text
+main:
+		lui	$t0,0x1001		# Table
+		lw	$t1,0($t0)
+		ori	$t2,$t0,0x4000		# Last
+		lw	$t3,0($t2)
+		addu	$t1,$t1,$t3
+		sw	$t1,4($t2)		# Total
+		lw	$t4,4($t2)
+		lw	$t5,-32752($gp)		# Table again
+		addi	$0,$0,0 #unsupported instruction, terminate
+
+		.data
+Table:		.word	7
+		.space	16380
+Last:		.word	35
+
+		.bss
+Total:		.space	4
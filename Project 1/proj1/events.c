@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "computer.h"
+#include "events.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAXSINKS 8
+
+static void NullSink (SimEvent* e, void* arg) {
+}
+
+EventSink emitSink = NullSink;
+void* emitArg = NULL;
+int eventsActive = FALSE;
+
+static struct {
+    EventSink sink;
+    void* arg;
+} sinks[MAXSINKS];
+static int numSinks = 0;
+
+static void FanOut (SimEvent* e, void* arg) {
+    int k;
+    for (k=0; k<numSinks; k++) {
+        (*sinks[k].sink) (e, sinks[k].arg);
+    }
+}
+
+/* Unregister all sinks. */
+void ClearEventSinks () {
+    numSinks = 0;
+    emitSink = NullSink;
+    emitArg = NULL;
+    eventsActive = FALSE;
+}
+
+/*
+ *  Register a sink to receive every event. Sinks are called in the
+ *  order they were added.
+ */
+void AddEventSink (EventSink sink, void* arg) {
+    if (numSinks == MAXSINKS) {
+        fprintf (stderr, "Too many event sinks.\n");
+        exit (1);
+    }
+    sinks[numSinks].sink = sink;
+    sinks[numSinks].arg = arg;
+    numSinks++;
+    if (numSinks == 1) {
+        emitSink = sink;
+        emitArg = arg;
+    } else {
+        emitSink = FanOut;
+        emitArg = NULL;
+    }
+    eventsActive = TRUE;
+}
+
+static const char* eventNames[] = {
+    "fetch", "decode", "reg", "mem", "branch", "trap", "retire"
+};
+static const char* trapNames[] = { "memory", "livelock", "budget", "divergence" };
+
+/*
+ *  One JSON object per line. Addresses and values are plain numbers;
+ *  fields that don't apply to an event are left out.
+ */
+static void JsonSink (SimEvent* e, void* arg) {
+    FILE* out = arg;
+    const char* p;
+
+    flockfile (out);
+    fprintf (out, "{\"ev\":\"%s\",\"hart\":%d,\"pc\":%u",
+        eventNames[e->kind], e->hart, (unsigned int)e->pc);
+    switch (e->kind) {
+        case EV_FETCH:
+        case EV_DECODE:
+            fprintf (out, ",\"instr\":%u", e->instr);
+        break;
+        case EV_REGWRITE:
+            fprintf (out, ",\"reg\":%d,\"value\":%d", e->reg, e->value);
+        break;
+        case EV_MEMWRITE:
+            fprintf (out, ",\"addr\":%u,\"value\":%d", (unsigned int)e->addr,
+                e->value);
+        break;
+        case EV_BRANCH:
+            fprintf (out, ",\"target\":%u,\"taken\":%s",
+                (unsigned int)e->target, e->taken ? "true" : "false");
+        break;
+        case EV_TRAP:
+            fprintf (out, ",\"trap\":\"%s\",\"addr\":%u,\"msg\":\"",
+                trapNames[e->trap], (unsigned int)e->addr);
+            for (p=e->message; *p; p++) {
+                if (*p == '"' || *p == '\\') {
+                    fputc ('\\', out);
+                }
+                fputc (*p, out);
+            }
+            fputc ('"', out);
+        break;
+        case EV_RETIRE:
+            fprintf (out, ",\"next\":%u,\"changedReg\":%d,\"changedMem\":%d",
+                (unsigned int)e->nextPc, e->changedReg, e->changedMem);
+        break;
+    }
+    fprintf (out, "}\n");
+    funlockfile (out);
+}
+
+/*
+ *  Binary trace: the 8 bytes "MIPSEVT1" followed by one 16-byte
+ *  record per event, in host byte order:
+ *
+ *    kind   reg   taken  hart   pc       a        b
+ *    u8     u8    u8     u8     u32      u32      u32
+ *
+ *  EV_FETCH, EV_DECODE:  a = instruction word
+ *  EV_REGWRITE:          reg, a = value
+ *  EV_MEMWRITE:          a = address, b = value
+ *  EV_BRANCH:            taken, a = target
+ *  EV_TRAP:              reg = TrapKind, a = address
+ *  EV_RETIRE:            reg = changed register (255 if none),
+ *                        a = next pc, b = changed address (or -1)
+ */
+typedef struct {
+    uint8_t kind, reg, taken, hart;
+    uint32_t pc, a, b;
+} BinaryEvent;
+
+static void BinarySink (SimEvent* e, void* arg) {
+    BinaryEvent r;
+
+    memset (&r, 0, sizeof(r));
+    r.kind = e->kind;
+    r.hart = e->hart;
+    r.pc = e->pc;
+    switch (e->kind) {
+        case EV_FETCH:
+        case EV_DECODE:
+            r.a = e->instr;
+        break;
+        case EV_REGWRITE:
+            r.reg = e->reg;
+            r.a = e->value;
+        break;
+        case EV_MEMWRITE:
+            r.a = e->addr;
+            r.b = e->value;
+        break;
+        case EV_BRANCH:
+            r.taken = e->taken;
+            r.a = e->target;
+        break;
+        case EV_TRAP:
+            r.reg = e->trap;
+            r.a = e->addr;
+        break;
+        case EV_RETIRE:
+            r.reg = e->changedReg < 0 ? 255 : e->changedReg;
+            r.a = e->nextPc;
+            r.b = e->changedMem;
+        break;
+    }
+    fwrite (&r, sizeof(r), 1, (FILE*)arg);
+}
+
+/*
+ *  Register a built-in sink given as "null", "text", "json[:file]"
+ *  or "bin[:file]"; json and bin write to stdout unless a file is
+ *  named. Return 0 on success, -1 if spec is not understood or the
+ *  file can't be opened.
+ */
+int AddNamedSink (const char* spec) {
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? colon - spec : strlen(spec);
+    FILE* out = stdout;
+
+    if (len == 4 && strncmp(spec, "null", 4) == 0 && colon == NULL) {
+        return 0;
+    }
+    if (len == 4 && strncmp(spec, "text", 4) == 0 && colon == NULL) {
+        AddEventSink (TextSink, NULL);
+        return 0;
+    }
+    if (!(len == 4 && strncmp(spec, "json", 4) == 0)
+        && !(len == 3 && strncmp(spec, "bin", 3) == 0)) {
+        return -1;
+    }
+    if (colon != NULL && (out = fopen(colon+1, "wb")) == NULL) {
+        return -1;
+    }
+    return AddStreamSink (len == 3 ? "bin" : "json", out);
+}
+
+/*
+ *  Register a json or bin sink writing to out. Return 0 on success, -1
+ *  if format is neither.
+ */
+int AddStreamSink (const char* format, FILE* out) {
+    if (strcmp(format, "bin") == 0) {
+        fwrite ("MIPSEVT1", 8, 1, out);
+        AddEventSink (BinarySink, out);
+    } else if (strcmp(format, "json") == 0) {
+        AddEventSink (JsonSink, out);
+    } else {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/*
+ *  Execution events. Simulate() reports what each instruction does as
+ *  a stream of events passed to the registered sinks, rather than
+ *  printing it. Every instruction produces EV_FETCH, then (unless the
+ *  program ends there) EV_DECODE, any of EV_REGWRITE, EV_MEMWRITE and
+ *  EV_BRANCH, and finally EV_RETIRE. EV_TRAP reports a simulation
+ *  stopped by an error or a limit. With several harts the sinks are
+ *  called from each hart's thread.
+ */
+
+typedef enum {
+    EV_FETCH = 0, EV_DECODE, EV_REGWRITE, EV_MEMWRITE, EV_BRANCH,
+    EV_TRAP, EV_RETIRE
+} EventKind;
+
+typedef enum { TRAP_MEMORY = 0, TRAP_LIVELOCK, TRAP_BUDGET, TRAP_DIVERGENCE } TrapKind;
+
+typedef struct {
+    EventKind kind;
+    int hart;               /* hart executing the instruction */
+    int pc;                 /* address of the instruction concerned */
+    unsigned int instr;     /* EV_FETCH, EV_DECODE: instruction word */
+    DecodedInstr* d;        /* EV_DECODE: decoded instruction */
+    int reg;                /* EV_REGWRITE: register written */
+    int addr;               /* EV_MEMWRITE, EV_TRAP: address accessed */
+    int value;              /* EV_REGWRITE, EV_MEMWRITE: value written */
+    int target, taken;      /* EV_BRANCH: branch target and outcome */
+    int nextPc;             /* EV_RETIRE: pc of the next instruction */
+    int changedReg;         /* EV_RETIRE: register updated, or -1 */
+    int changedMem;         /* EV_RETIRE: memory address updated, or -1 */
+    TrapKind trap;          /* EV_TRAP */
+    const char* message;    /* EV_TRAP: human readable description */
+} SimEvent;
+
+typedef void (*EventSink) (SimEvent*, void* arg);
+
+/*
+ *  emitSink is the only registered sink, or a fan-out to all of them
+ *  when there are several. When it is TextSink, the default, Emit()
+ *  calls TextSink by name, a direct call the compiler can inline into
+ *  Simulate(); any other sink is called through the pointer.
+ *  eventsActive is FALSE when no sink is registered; the simulator
+ *  then skips building events at all.
+ */
+extern EventSink emitSink;
+extern void* emitArg;
+extern int eventsActive;
+
+#define Emit(e) (emitSink == TextSink ? TextSink ((e), emitArg) \
+    : (*emitSink) ((e), emitArg))
+
+void AddEventSink (EventSink, void* arg);
+void ClearEventSinks ();
+int AddNamedSink (const char* spec);
+int AddStreamSink (const char* format, FILE*);
+
+/* Defined in computer.c: the original trace format, on stdout */
+void TextSink (SimEvent*, void*);
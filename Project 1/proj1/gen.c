@@ -0,0 +1,291 @@
+/*
+ *  Generate a random program for the simulator, written as a .dump
+ *  file. Programs use only the instructions Decode() supports, never
+ *  fault and, unless they loop forever (-i), always end.
+ *
+ *  The program is a nest of counted loops with the body instructions
+ *  spread among the levels. Memory instructions address a working set
+ *  of -f bytes from 0x00401000 through a pointer that moves -S bytes
+ *  each innermost iteration, wrapping within the working set. Forward
+ *  branches over 1 to 3 body instructions are mixed in at density -b.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAXLOOPS 5
+
+/* Instruction classes that make up the body */
+typedef enum { ALU=0, IMM, SHIFT, LOAD, STORE, NUMCLASSES } InstrClass;
+
+static const char* className[NUMCLASSES] = { "alu", "imm", "shift", "load", "store" };
+
+/* Registers the body may read and write: $v0-$v1, $a0-$a3, $t0-$t7 */
+static const int scratch[] = { 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+#define NUMSCRATCH (sizeof(scratch)/sizeof(scratch[0]))
+
+#define BASE 16         /* $s0: 0x00401000 */
+#define INDEX 17        /* $s1: offset of the pointer in the working set */
+#define COUNTER 18      /* $s2 up: loop counters, outermost first */
+#define FOREVER 23      /* $s7: iterations of the -i loop */
+#define POINTER 25      /* $t9: BASE + INDEX */
+
+#define WINDOW 64       /* bytes addressed above the pointer */
+
+static unsigned int program[MAXNUMINSTRS];
+static int size = 0;
+static unsigned long long seed = 1;
+
+/* xorshift64*, so a seed gives the same program everywhere */
+static unsigned int Random () {
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return (seed * 2685821657736338717ULL) >> 32;
+}
+
+static int Pick (int n) {
+    return Random () % n;
+}
+
+static int Scratch () {
+    return scratch[Pick (NUMSCRATCH)];
+}
+
+static void Emit (unsigned int word) {
+    if (size == MAXNUMINSTRS) {
+        fprintf (stderr, "Program too big; use fewer instructions.\n");
+        exit (1);
+    }
+    program[size++] = word;
+}
+
+static unsigned int RType (int rs, int rt, int rd, int shamt, int funct) {
+    return (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | funct;
+}
+
+static unsigned int IType (int op, int rs, int rt, int immed) {
+    return (op << 26) | (rs << 21) | (rt << 16) | (immed & 0xffff);
+}
+
+/* Branch from the word at index "from" to index "to". */
+static unsigned int Branch (int op, int rs, int rt, int from, int to) {
+    return IType (op, rs, rt, to - (from+1));
+}
+
+/* One body instruction of class c. */
+static void EmitClass (InstrClass c) {
+    static const int aluFunct[] = { 33, 35, 36, 37, 42 };  /* addu subu and or slt */
+    static const int immOp[] = { 9, 12, 13, 15 };          /* addiu andi ori lui */
+    int op;
+
+    switch (c) {
+        case ALU:
+            Emit (RType (Scratch (), Scratch (), Scratch (), 0, aluFunct[Pick (5)]));
+        break;
+        case IMM:
+            op = immOp[Pick (4)];
+            Emit (IType (op, op == 15 ? 0 : Scratch (), Scratch (), Random ()));
+        break;
+        case SHIFT:
+            Emit (RType (0, Scratch (), Scratch (), Pick (32), Pick (2) ? 0 : 2));
+        break;
+        case LOAD:
+            Emit (IType (35, POINTER, Scratch (), 4*Pick (WINDOW/4)));
+        break;
+        case STORE:
+            Emit (IType (43, POINTER, Scratch (), 4*Pick (WINDOW/4)));
+        break;
+        default:
+        break;
+    }
+}
+
+/*
+ *  n body instructions drawn from the mix, of which about branchPercent
+ *  in a hundred are forward branches.
+ */
+static void EmitBody (int n, int mix[], int branchPercent) {
+    int total = 0, k, r, c, skip;
+
+    for (c=0; c<NUMCLASSES; c++) {
+        total += mix[c];
+    }
+    for (k=0; k<n; k++) {
+        if (k+1 < n && Pick (100) < branchPercent) {
+            /* skip some of the body instructions still to come */
+            skip = 1 + Pick (n-k-1 < 3 ? n-k-1 : 3);
+            Emit (Branch (Pick (2) ? 4 : 5, Scratch (), Scratch (), size, size+1+skip));
+            continue;
+        }
+        r = Pick (total);
+        for (c=0; r >= mix[c]; c++) {
+            r -= mix[c];
+        }
+        EmitClass (c);
+    }
+}
+
+/* Load the constant value into register reg. */
+static void EmitConstant (int reg, unsigned int value) {
+    Emit (IType (15, 0, reg, value >> 16));                /* lui */
+    Emit (IType (13, reg, reg, value & 0x7fff));           /* ori, whose immediate is sign extended */
+}
+
+/*
+ *  Loop level "level" of "loops", running "trips" times, with the body
+ *  instructions of the remaining levels.
+ */
+static void EmitLoop (int level, int loops, int trips, int body, int mix[],
+    int branchPercent, int footprint, int stride) {
+    int start, here = body / (loops - level + 1);
+
+    if (level == loops) {
+        EmitBody (body, mix, branchPercent);
+        /* move the pointer along the working set */
+        Emit (IType (9, INDEX, INDEX, stride));                 /* addiu */
+        Emit (IType (12, INDEX, INDEX, (footprint-1) & ~3));    /* andi */
+        Emit (RType (BASE, INDEX, POINTER, 0, 33));             /* addu */
+        return;
+    }
+    EmitBody (here, mix, branchPercent);
+    Emit (IType (9, 0, COUNTER+level, trips));
+    start = size;
+    EmitLoop (level+1, loops, trips, body-here, mix, branchPercent, footprint, stride);
+    Emit (IType (9, COUNTER+level, COUNTER+level, -1));
+    Emit (Branch (5, COUNTER+level, 0, size, start));
+}
+
+/* Parse a mix such as "alu=40,load=20" into mix[], which is left as is for classes not named. */
+static int ParseMix (char* spec, int mix[]) {
+    char* item;
+    int c, len;
+
+    for (item=strtok (spec, ","); item != NULL; item=strtok (NULL, ",")) {
+        for (c=0; c<NUMCLASSES; c++) {
+            len = strlen (className[c]);
+            if (strncmp (item, className[c], len) == 0 && item[len] == '=') {
+                mix[c] = atoi (item+len+1);
+                break;
+            }
+        }
+        if (c == NUMCLASSES || mix[c] < 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void Usage () {
+    fprintf (stderr, "Usage: gen [options] file.dump\n");
+    fprintf (stderr, "  -s seed        random seed (1)\n");
+    fprintf (stderr, "  -n count       body instructions (200)\n");
+    fprintf (stderr, "  -m mix         weights, e.g. alu=40,imm=20,shift=10,load=20,store=10\n");
+    fprintf (stderr, "  -b percent     forward branches among body instructions (10)\n");
+    fprintf (stderr, "  -l loops       loop nesting depth, 0 to %d (2)\n", MAXLOOPS);
+    fprintf (stderr, "  -t trips       iterations of each loop (10)\n");
+    fprintf (stderr, "  -f bytes       working set, a power of two from %d to 8192 (1024)\n", WINDOW);
+    fprintf (stderr, "  -S bytes       pointer stride, a multiple of 4 (4)\n");
+    fprintf (stderr, "  -i             repeat forever, for use with sim -n\n");
+    exit (1);
+}
+
+int main (int argc, char *argv[]) {
+    int mix[NUMCLASSES] = { 40, 20, 10, 20, 10 };
+    int body = 200, branchPercent = 10, loops = 2, trips = 10;
+    int footprint = 1024, stride = 4, forever = FALSE;
+    int argIndex, k, start = 0, total = 0;
+    unsigned char bytes[4];
+    FILE* out;
+
+    for (argIndex=1; argIndex<argc && argv[argIndex][0]=='-'; argIndex++) {
+        if (argv[argIndex][1] == 'i') {
+            forever = TRUE;
+            continue;
+        }
+        if (argIndex+1 >= argc || argv[argIndex][2] != '\0') {
+            Usage ();
+        }
+        /* the other options all take a value, in the next argument */
+        switch (argv[argIndex][1]) {
+            case 's':
+            seed = strtoull (argv[++argIndex], NULL, 0);
+            break;
+            case 'n':
+            body = atoi (argv[++argIndex]);
+            break;
+            case 'm':
+            if (!ParseMix (argv[++argIndex], mix)) {
+                Usage ();
+            }
+            break;
+            case 'b':
+            branchPercent = atoi (argv[++argIndex]);
+            break;
+            case 'l':
+            loops = atoi (argv[++argIndex]);
+            break;
+            case 't':
+            trips = atoi (argv[++argIndex]);
+            break;
+            case 'f':
+            footprint = atoi (argv[++argIndex]);
+            break;
+            case 'S':
+            stride = atoi (argv[++argIndex]);
+            break;
+            default:
+            Usage ();
+        }
+    }
+    for (k=0; k<NUMCLASSES; k++) {
+        total += mix[k];
+    }
+    if (argIndex != argc-1 || body < 0 || total <= 0 || branchPercent < 0
+        || loops < 0 || loops > MAXLOOPS || trips < 1 || trips > 32767
+        || footprint < WINDOW || footprint > 8192 || (footprint & (footprint-1)) != 0
+        || stride % 4 != 0 || stride < -32768 || stride > 32767) {
+        Usage ();
+    }
+    /* xorshift must not start from zero */
+    if (seed == 0) {
+        seed = 0x9e3779b97f4a7c15ULL;
+    }
+
+    EmitConstant (BASE, 0x00401000);
+    Emit (IType (9, 0, INDEX, 0));
+    Emit (RType (BASE, INDEX, POINTER, 0, 33));
+    for (k=0; k<NUMSCRATCH; k++) {
+        EmitConstant (scratch[k], Random ());
+    }
+    if (forever) {
+        start = size;
+    }
+    EmitLoop (0, loops, trips, body, mix, branchPercent, footprint, stride);
+    if (forever) {
+        /* count the iterations, so the state never repeats */
+        Emit (IType (9, FOREVER, FOREVER, 1));
+        Emit ((2 << 26) | ((0x00400000 + 4*start) >> 2));  /* j */
+    }
+    Emit (0);
+
+    out = fopen (argv[argIndex], "wb");
+    if (out == NULL) {
+        fprintf (stderr, "Can't open file: %s\n", argv[argIndex]);
+        exit (1);
+    }
+    /* .dump files hold little-endian words */
+    for (k=0; k<size; k++) {
+        bytes[0] = program[k];
+        bytes[1] = program[k] >> 8;
+        bytes[2] = program[k] >> 16;
+        bytes[3] = program[k] >> 24;
+        fwrite (bytes, 4, 1, out);
+    }
+    fclose (out);
+    return 0;
+}
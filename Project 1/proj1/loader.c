@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <elf.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include "computer.h"
+#include "loader.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define MEMBASE 0x00400000
+#define MEMTOP (MEMBASE + (MAXNUMINSTRS+MAXNUMDATA)*4)
+
+static void Fail (const char* message) {
+    fprintf (stderr, "Can't load ELF file: %s.\n", message);
+    exit (1);
+}
+
+/* Does the file start with the ELF magic number? Leaves it rewound. */
+int IsElf (FILE* f) {
+    unsigned char magic[SELFMAG];
+    int elf = fread (magic, SELFMAG, 1, f) == 1 && memcmp (magic, ELFMAG, SELFMAG) == 0;
+    rewind (f);
+    return elf;
+}
+
+/*
+ *  The whole file, mapped if it can be and read otherwise. The
+ *  contents are big-endian, and guest memory holds words in host
+ *  order, so segments are copied into memory rather than mapped there.
+ */
+static const unsigned char* MapFile (FILE* f, size_t* size, int* mapped) {
+    struct stat st;
+    unsigned char* data;
+    size_t got = 0, max = 4096;
+    int n;
+
+    if (fstat (fileno (f), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (f), 0);
+        if (data != MAP_FAILED) {
+            madvise (data, st.st_size, MADV_SEQUENTIAL);
+            *size = st.st_size;
+            *mapped = TRUE;
+            return data;
+        }
+    }
+    data = malloc (max);
+    while (data != NULL && (n = fread (data+got, 1, max-got, f)) > 0) {
+        got += n;
+        if (got == max) {
+            max *= 2;
+            data = realloc (data, max);
+        }
+    }
+    if (data == NULL) {
+        Fail ("out of memory");
+    }
+    *size = got;
+    *mapped = FALSE;
+    return data;
+}
+
+static unsigned int Word (const unsigned char* p) {
+    unsigned int w;
+    memcpy (&w, p, 4);
+    return ntohl (w);
+}
+
+static unsigned int Half (const unsigned char* p) {
+    return (p[0] << 8) | p[1];
+}
+
+/*
+ *  Copy n bytes of segment data to guest address addr. Guest words
+ *  hold the big-endian value of their four bytes.
+ */
+static void CopyBytes (unsigned int addr, const unsigned char* p, size_t n) {
+    int* w;
+    int shift;
+    while (n > 0 && addr % 4 != 0) {
+        w = ProgramWord (addr & ~3);
+        shift = 8 * (3 - addr % 4);
+        *w = (*w & ~(0xff << shift)) | (*p << shift);
+        addr++, p++, n--;
+    }
+    for (; n >= 4; addr += 4, p += 4, n -= 4) {
+        *ProgramWord (addr) = Word (p);
+    }
+    for (; n > 0; addr++, p++, n--) {
+        w = ProgramWord (addr & ~3);
+        shift = 8 * (3 - addr % 4);
+        *w = (*w & ~(0xff << shift)) | (*p << shift);
+    }
+}
+
+/* Return the value of the symbol _gp, or -1 if there is none. */
+static int FindGp (const unsigned char* file, size_t size) {
+    unsigned int shoff = Word (file + offsetof(Elf32_Ehdr, e_shoff));
+    unsigned int shentsize = Half (file + offsetof(Elf32_Ehdr, e_shentsize));
+    unsigned int shnum = Half (file + offsetof(Elf32_Ehdr, e_shnum));
+    const unsigned char *sh, *strtab, *sym;
+    unsigned int k, j, offset, bytes, link, name, strOffset, strSize;
+
+    if (shoff == 0 || shentsize < sizeof(Elf32_Shdr)
+        || shoff > size || shnum > (size - shoff) / shentsize) {
+        return -1;
+    }
+    for (k=0; k<shnum; k++) {
+        sh = file + shoff + k*shentsize;
+        if (Word (sh + offsetof(Elf32_Shdr, sh_type)) != SHT_SYMTAB) {
+            continue;
+        }
+        offset = Word (sh + offsetof(Elf32_Shdr, sh_offset));
+        bytes = Word (sh + offsetof(Elf32_Shdr, sh_size));
+        link = Word (sh + offsetof(Elf32_Shdr, sh_link));
+        if (offset > size || bytes > size - offset || link >= shnum) {
+            continue;
+        }
+        strtab = file + shoff + link*shentsize;
+        strOffset = Word (strtab + offsetof(Elf32_Shdr, sh_offset));
+        strSize = Word (strtab + offsetof(Elf32_Shdr, sh_size));
+        if (strOffset > size || strSize > size - strOffset) {
+            continue;
+        }
+        for (j=0; j+sizeof(Elf32_Sym) <= bytes; j += sizeof(Elf32_Sym)) {
+            sym = file + offset + j;
+            name = Word (sym + offsetof(Elf32_Sym, st_name));
+            if (name + 4 <= strSize && memcmp (file + strOffset + name, "_gp", 4) == 0) {
+                return Word (sym + offsetof(Elf32_Sym, st_value));
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ *  Load the executable f into memory and the arena, which must be
+ *  clear, and describe it in *image. Exit with a message if it isn't a MIPS
+ *  executable whose segments fit in memory and whose entry point is a
+ *  word of its text.
+ */
+void LoadElf (FILE* f, ElfImage* image) {
+    size_t size;
+    int mapped;
+    const unsigned char* file = MapFile (f, &size, &mapped);
+    const unsigned char* ph;
+    unsigned int phoff, phentsize, phnum, k;
+    unsigned int vaddr, offset, filesz, memsz, flags, end, dataStart = 0xffffffff;
+    char message[200];
+
+    if (size < sizeof(Elf32_Ehdr) || file[EI_CLASS] != ELFCLASS32
+        || file[EI_DATA] != ELFDATA2MSB) {
+        Fail ("not a 32-bit big-endian ELF file");
+    }
+    if (Half (file + offsetof(Elf32_Ehdr, e_machine)) != EM_MIPS
+        || Half (file + offsetof(Elf32_Ehdr, e_type)) != ET_EXEC) {
+        Fail ("not a MIPS executable");
+    }
+    phoff = Word (file + offsetof(Elf32_Ehdr, e_phoff));
+    phentsize = Half (file + offsetof(Elf32_Ehdr, e_phentsize));
+    phnum = Half (file + offsetof(Elf32_Ehdr, e_phnum));
+    if (phentsize < sizeof(Elf32_Phdr) || phoff > size
+        || phnum > (size - phoff) / phentsize) {
+        Fail ("bad program header table");
+    }
+
+    image->entry = Word (file + offsetof(Elf32_Ehdr, e_entry));
+    image->textWords = 0;
+    image->dataEnd = DATABASE;
+    for (k=0; k<phnum; k++) {
+        ph = file + phoff + k*phentsize;
+        if (Word (ph + offsetof(Elf32_Phdr, p_type)) != PT_LOAD) {
+            continue;
+        }
+        vaddr = Word (ph + offsetof(Elf32_Phdr, p_vaddr));
+        offset = Word (ph + offsetof(Elf32_Phdr, p_offset));
+        filesz = Word (ph + offsetof(Elf32_Phdr, p_filesz));
+        memsz = Word (ph + offsetof(Elf32_Phdr, p_memsz));
+        flags = Word (ph + offsetof(Elf32_Phdr, p_flags));
+        if (memsz == 0) {
+            continue;
+        }
+        if (vaddr >= DATABASE && vaddr <= HEAPBASE && memsz <= HEAPBASE - vaddr
+            && !(flags & PF_X)) {
+            if (vaddr + memsz > image->dataEnd) {
+                image->dataEnd = (vaddr + memsz + 3) & ~3;
+            }
+        } else if (vaddr < MEMBASE || vaddr > MEMTOP || memsz > MEMTOP - vaddr) {
+            sprintf (message, "segment at 0x%8.8x outside simulated memory, "
+                "0x%8.8x to 0x%8.8x for text and data or 0x%8.8x to "
+                "0x%8.8x for data", vaddr, MEMBASE, MEMTOP, DATABASE, HEAPBASE);
+            Fail (message);
+        }
+        if (filesz > memsz) {
+            Fail ("segment with more bytes in the file than in memory");
+        }
+        if (offset > size || filesz > size - offset) {
+            Fail ("segment past the end of the file");
+        }
+        /* the bytes past filesz are .bss, already zero */
+        CopyBytes (vaddr, file + offset, filesz);
+        end = (vaddr + memsz - MEMBASE + 3) / 4;
+        if (flags & PF_X) {
+            if (end > MAXNUMINSTRS) {
+                Fail ("text doesn't fit below 0x00401000");
+            }
+            if (end > image->textWords) {
+                image->textWords = end;
+            }
+        } else if (vaddr < dataStart) {
+            dataStart = vaddr;
+        }
+    }
+    if (image->entry % 4 != 0 || image->entry < MEMBASE
+        || image->entry >= MEMBASE + 4*image->textWords) {
+        sprintf (message, "entry point 0x%8.8x outside the text segment",
+            image->entry);
+        Fail (message);
+    }
+    image->gp = FindGp (file, size);
+    if (image->gp == -1) {
+        image->gp = (dataStart == 0xffffffff ? MEMBASE + MAXNUMINSTRS*4 : dataStart) + 0x7ff0;
+    }
+    if (mapped) {
+        munmap ((void*)file, size);
+    } else {
+        free ((void*)file);
+    }
+}
@@ -0,0 +1,20 @@
+/*
+ *  Loader for ELF32 big-endian MIPS executables, as an alternative to
+ *  the raw instruction dumps InitComputer() reads. Executable segments
+ *  form the text segment, which must lie in the first 4 KB from
+ *  0x00400000. Data segments (.data, .bss) may follow it in the 12 KB
+ *  of data memory up to 0x00404000, or be linked at the usual MIPS
+ *  addresses, from DATABASE (0x10000000, .data normally at 0x10010000)
+ *  up to the heap at HEAPBASE, which gives them 256 KB. There they are
+ *  backed by the arena a page at a time, like the heap.
+ */
+
+typedef struct {
+    int entry;              /* e_entry */
+    int gp;                 /* _gp if defined, else start of data + 0x7ff0 */
+    int textWords;          /* words of text from 0x00400000 */
+    int dataEnd;            /* end of the data from DATABASE up, or DATABASE */
+} ElfImage;
+
+int IsElf (FILE*);
+void LoadElf (FILE*, ElfImage*);
@@ -0,0 +1,246 @@
+/*
+ *  Golden-output regression runner. Every .dump or .elf in the given
+ *  directories that has a .output beside it is run through sim, and
+ *  sim's output is compared line by line against the .output as it is
+ *  produced, stopping at the first difference. A failure reports the
+ *  line, the instruction being traced there and the lines before it.
+ *  Tests run in parallel, -j at a time.
+ *
+ *  Usage: regress [-j jobs] [-s sim] [-a "sim options"] [directory ...]
+ *  The directories default to ../test_c and the current directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define CONTEXT 5               /* expected lines shown before a difference */
+#define MAXARGS 32
+
+static char* simPath = "./sim";
+static char* simArgs[MAXARGS];
+static int numSimArgs = 0;
+
+/* The report of one test, written out in one piece. */
+static char report[16384];
+static int reportSize = 0;
+
+static void Report (const char* format, const char* a, const char* b) {
+    int n = snprintf (report+reportSize, sizeof(report)-reportSize, format, a, b);
+    if (n > 0) {
+        reportSize += n;
+        if (reportSize >= sizeof(report)) {
+            reportSize = sizeof(report)-1;
+        }
+    }
+}
+
+/* Remove any newline from the end of line. */
+static char* Chomp (char* line) {
+    line[strcspn (line, "\n")] = '\0';
+    return line;
+}
+
+/* Start sim on dump; return its output and its pid in *pid. */
+static FILE* StartSim (const char* dump, pid_t* pid) {
+    char* argv[MAXARGS+3];
+    int fds[2], k, null;
+
+    if (pipe (fds) != 0 || (*pid = fork ()) < 0) {
+        perror ("regress");
+        exit (2);
+    }
+    if (*pid == 0) {
+        null = open ("/dev/null", O_RDWR);
+        dup2 (null, 0);
+        dup2 (fds[1], 1);
+        dup2 (null, 2);
+        close (fds[0]);
+        argv[0] = simPath;
+        for (k=0; k<numSimArgs; k++) {
+            argv[k+1] = simArgs[k];
+        }
+        argv[k+1] = (char*)dump;
+        argv[k+2] = NULL;
+        execv (simPath, argv);
+        _exit (127);
+    }
+    close (fds[1]);
+    return fdopen (fds[0], "r");
+}
+
+/*
+ *  Run one test, comparing sim's output for dump with the golden file.
+ *  Return TRUE if they match.
+ */
+static int RunTest (const char* dump, const char* golden) {
+    FILE *expected, *actual;
+    char *want = NULL, *got = NULL;
+    size_t wantMax = 0, gotMax = 0;
+    ssize_t wantLen, gotLen;
+    char* context[CONTEXT] = { NULL };
+    char* instruction = NULL;
+    long line = 0;
+    int k, status, same = TRUE;
+    char number[32];
+    pid_t pid;
+
+    expected = fopen (golden, "r");
+    if (expected == NULL) {
+        Report ("FAIL %s: can't open %s\n", dump, golden);
+        return FALSE;
+    }
+    actual = StartSim (dump, &pid);
+    while (1) {
+        wantLen = getline (&want, &wantMax, expected);
+        gotLen = getline (&got, &gotMax, actual);
+        line++;
+        if (wantLen < 0 && gotLen < 0) {
+            break;
+        }
+        if (wantLen < 0 || gotLen < 0 || strcmp (want, got) != 0) {
+            same = FALSE;
+            break;
+        }
+        if (strncmp (want, "Executing instruction", 21) == 0) {
+            free (instruction);
+            instruction = strdup (want);
+        }
+        free (context[line % CONTEXT]);
+        context[line % CONTEXT] = strdup (want);
+    }
+    if (!same) {
+        /* sim may still be writing; it needn't finish */
+        kill (pid, SIGKILL);
+    }
+    fclose (actual);
+    waitpid (pid, &status, 0);
+
+    if (same && WIFSIGNALED(status)) {
+        Report ("FAIL %s: sim died with signal %s\n", dump, strsignal (WTERMSIG(status)));
+        same = FALSE;
+    } else if (!same) {
+        sprintf (number, "%ld", line);
+        Report ("FAIL %s: output differs at line %s\n", dump, number);
+        if (instruction != NULL && strcmp (instruction, want) != 0) {
+            Report ("  in the instruction at %s\n", Chomp (instruction) + 25, "");
+        }
+        for (k=line-CONTEXT+1; k<line; k++) {
+            if (k > 0) {
+                Report ("    %s\n", Chomp (context[k % CONTEXT]), "");
+            }
+        }
+        Report ("  - %s\n", wantLen < 0 ? "(end of output)" : Chomp (want), "");
+        Report ("  + %s\n", gotLen < 0 ? "(end of output)" : Chomp (got), "");
+    }
+    fclose (expected);
+    return same;
+}
+
+/* Does name end in suffix? */
+static int EndsWith (const char* name, const char* suffix) {
+    size_t n = strlen (name), s = strlen (suffix);
+    return n > s && strcmp (name + n - s, suffix) == 0;
+}
+
+int main (int argc, char *argv[]) {
+    static char* defaults[] = { "../test_c", "." };
+    char** dirs = defaults;
+    int numDirs = 2;
+    int jobs = sysconf (_SC_NPROCESSORS_ONLN);
+    int running = 0, passed = 0, failed = 0, skipped = 0;
+    int argIndex, d, status;
+    char dump[4096], golden[4096];
+    char* word;
+    struct dirent* entry;
+    DIR* dir;
+    pid_t pid;
+
+    for (argIndex=1; argIndex<argc && argv[argIndex][0]=='-'; argIndex++) {
+        if (argIndex+1 >= argc) {
+            fprintf (stderr, "Usage: regress [-j jobs] [-s sim] [-a \"sim options\"] [directory ...]\n");
+            exit (2);
+        }
+        switch (argv[argIndex][1]) {
+            case 'j':
+            jobs = atoi (argv[++argIndex]);
+            break;
+            case 's':
+            simPath = argv[++argIndex];
+            break;
+            case 'a':
+            for (word=strtok (argv[++argIndex], " "); word != NULL; word=strtok (NULL, " ")) {
+                if (numSimArgs < MAXARGS) {
+                    simArgs[numSimArgs++] = word;
+                }
+            }
+            break;
+            default:
+            fprintf (stderr, "Invalid option \"%s\".\n", argv[argIndex]);
+            exit (2);
+        }
+    }
+    if (argIndex < argc) {
+        dirs = argv + argIndex;
+        numDirs = argc - argIndex;
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    for (d=0; d<numDirs; d++) {
+        dir = opendir (dirs[d]);
+        if (dir == NULL) {
+            fprintf (stderr, "Can't open directory: %s\n", dirs[d]);
+            exit (2);
+        }
+        while ((entry = readdir (dir)) != NULL) {
+            if (!EndsWith (entry->d_name, ".dump") && !EndsWith (entry->d_name, ".elf")) {
+                continue;
+            }
+            snprintf (dump, sizeof(dump), "%s/%s", dirs[d], entry->d_name);
+            snprintf (golden, sizeof(golden), "%.*s.output",
+                (int)(strrchr (dump, '.') - dump), dump);
+            if (access (golden, R_OK) != 0) {
+                printf ("SKIP %s: no %s\n", dump, golden);
+                skipped++;
+                continue;
+            }
+            if (running == jobs) {
+                wait (&status);
+                running--;
+                WIFEXITED(status) && WEXITSTATUS(status) == 0 ? passed++ : failed++;
+            }
+            fflush (stdout);
+            pid = fork ();
+            if (pid < 0) {
+                perror ("regress");
+                exit (2);
+            }
+            if (pid == 0) {
+                status = RunTest (dump, golden);
+                if (status) {
+                    Report ("PASS %s\n", dump, "");
+                }
+                write (1, report, reportSize);
+                _exit (status ? 0 : 1);
+            }
+            running++;
+        }
+        closedir (dir);
+    }
+    while (running > 0) {
+        wait (&status);
+        running--;
+        WIFEXITED(status) && WEXITSTATUS(status) == 0 ? passed++ : failed++;
+    }
+    printf ("%d passed, %d failed, %d skipped\n", passed, failed, skipped);
+    return failed == 0 ? 0 : 1;
+}
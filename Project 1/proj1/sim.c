@@ -1,6 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "computer.h"
+#include "cfg.h"
+#include "events.h"
+#include "simd.h"
+#include "counters.h"
 
 #define TRUE 1
 #define FALSE 0
@@ -11,6 +16,15 @@ int main (int argc, char *argv[]) {
     int printingMemory = FALSE;
     int debugging = FALSE;
     int interactive = FALSE;
+    int printingCFG = FALSE;
+    long long budget = 0;
+    long long lockstep = 0;
+    int harts = 1, quantum = 100, deterministic = TRUE;
+    char* socketPath = NULL;
+    char* countersPath = NULL;
+    int workers = 0;
+    int numSinks = 0;
+    Engine engine = ENGINE_FAST;
     FILE *filein;
 
     if (argc < 2) {
@@ -18,7 +32,8 @@ int main (int argc, char *argv[]) {
         exit (1);
     }
     for (argIndex=1; argIndex<argc && argv[argIndex][0]=='-'; argIndex++) {
-        /* Argument is an option, we hope one of -r, -m, -i, -d. */
+        /* Argument is an option, we hope one of -r, -m, -i, -d, -x, -g, -n, -e,
+         * -t, -q, -f, -S, -w, -l, -c. */
         switch (argv[argIndex][1]) {
             case 'r':
             printingRegisters = TRUE;
@@ -32,18 +47,109 @@ int main (int argc, char *argv[]) {
             case 'd':
             debugging = TRUE;
             break;
+            case 'x':
+            engine = ENGINE_REFERENCE;
+            break;
+            case 'g':
+            printingCFG = TRUE;
+            break;
+            case 'n':
+            /* Instruction budget, in the next argument. */
+            if (argIndex+1 >= argc || atoll (argv[argIndex+1]) <= 0) {
+                fprintf (stderr, "-n needs a positive instruction count.\n");
+                exit (1);
+            }
+            budget = atoll (argv[++argIndex]);
+            break;
+            case 'l':
+            /* Lockstep check interval, in the next argument. */
+            if (argIndex+1 >= argc || atoll (argv[argIndex+1]) <= 0) {
+                fprintf (stderr, "-l needs a positive instruction count.\n");
+                exit (1);
+            }
+            lockstep = atoll (argv[++argIndex]);
+            break;
+            case 't':
+            /* Number of harts, in the next argument. */
+            if (argIndex+1 >= argc || atoi (argv[argIndex+1]) <= 0) {
+                fprintf (stderr, "-t needs a positive number of harts.\n");
+                exit (1);
+            }
+            if (atoi (argv[argIndex+1]) > MAXHARTS) {
+                fprintf (stderr, "-t allows at most %d harts, whose stacks fill the data segment.\n", MAXHARTS);
+                exit (1);
+            }
+            harts = atoi (argv[++argIndex]);
+            break;
+            case 'q':
+            /* Instructions per hart turn, in the next argument. */
+            if (argIndex+1 >= argc || atoi (argv[argIndex+1]) <= 0) {
+                fprintf (stderr, "-q needs a positive instruction count.\n");
+                exit (1);
+            }
+            quantum = atoi (argv[++argIndex]);
+            break;
+            case 'f':
+            deterministic = FALSE;
+            break;
+            case 'S':
+            /* Serve runs on the socket named in the next argument. */
+            if (argIndex+1 >= argc) {
+                fprintf (stderr, "-S needs a socket path.\n");
+                exit (1);
+            }
+            socketPath = argv[++argIndex];
+            break;
+            case 'w':
+            /* Server worker processes, in the next argument. */
+            if (argIndex+1 >= argc || atoi (argv[argIndex+1]) <= 0) {
+                fprintf (stderr, "-w needs a positive number of workers.\n");
+                exit (1);
+            }
+            workers = atoi (argv[++argIndex]);
+            break;
+            case 'c':
+            /* Counters file, in the next argument. */
+            if (argIndex+1 >= argc) {
+                fprintf (stderr, "-c needs a file name, or - for standard error.\n");
+                exit (1);
+            }
+            countersPath = argv[++argIndex];
+            break;
+            case 'e':
+            /* Event sink, in the next argument; may be repeated. */
+            if (argIndex+1 >= argc || AddNamedSink (argv[argIndex+1]) != 0) {
+                fprintf (stderr, "-e needs null, text, json[:file] or bin[:file].\n");
+                exit (1);
+            }
+            argIndex++;
+            numSinks++;
+            break;
             default:
             fprintf (stderr, "Invalid option \"%s\".\n", argv[argIndex]);
-            fprintf (stderr, "Correct options are -r, -m, -i, -d.\n");
+            fprintf (stderr, "Correct options are -r, -m, -i, -d, -x, -g, -n <count>,\n");
+            fprintf (stderr, "-e null|text|json[:file]|bin[:file], -t <harts>, -q <count>, -f,\n");
+            fprintf (stderr, "-S <socket>, -w <workers>, -l <count>, -c <file>.\n");
             exit (1);
         }
     }
+    if (socketPath != NULL) {
+        /* simd mode: programs arrive over the socket */
+        SelectEngine (engine);
+        Serve (socketPath, workers, budget);
+    }
     if (argIndex == argc) {
         fprintf (stderr, "No file name given.\n");
         exit (1);
     } else if (argIndex < argc-1) {
         fprintf (stderr, "Too many arguments.\n");
         exit (1);
+    } else if (interactive && harts > 1) {
+        fprintf (stderr, "-i can't be used with more than one hart.\n");
+        exit (1);
+    } else if (lockstep != 0 && (interactive || harts > 1)) {
+        fprintf (stderr, "-l can't be used with -i or more than one hart.\n");
+        exit (1);
     }
     
     filein = fopen (argv[argIndex], "r");
@@ -54,6 +160,21 @@ int main (int argc, char *argv[]) {
     
     InitComputer (filein, printingRegisters, printingMemory,
 	debugging, interactive);
+    if (printingCFG) {
+        /* Print the program's control-flow graph instead of running it. */
+        PrintCFGDot (ProgramCFG (), stdout);
+        return 0;
+    }
+    if (numSinks == 0) {
+        AddNamedSink ("text");
+    }
+    SelectEngine (engine);
+    SetInstructionBudget (budget);
+    SetHarts (harts, quantum, deterministic);
+    SetLockstep (lockstep);
+    if (countersPath != NULL) {
+        EnableCounters (countersPath);
+    }
     Simulate ();
     return 0;
 }
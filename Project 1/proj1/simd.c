@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "computer.h"
+#include "events.h"
+#include "simd.h"
+
+#define TRUE 1
+#define FALSE 0
+
+extern __thread Computer mips;
+
+static long long defaultBudget;
+
+/* The reply to one request, sent with a single write. */
+static char* reply;
+static size_t replySize, replyMax;
+
+static void Append (const void* data, size_t n) {
+    if (replySize + n > replyMax) {
+        replyMax = 2*(replySize + n);
+        reply = realloc (reply, replyMax);
+        if (reply == NULL) {
+            fprintf (stderr, "simd: out of memory.\n");
+            exit (1);
+        }
+    }
+    memcpy (reply+replySize, data, n);
+    replySize += n;
+}
+
+/*
+ *  The trace of one run, kept up to MAXTRACE bytes. Past that the rest
+ *  is dropped and lost is set, so a long run can't fill memory or
+ *  overflow a frame's length.
+ */
+typedef struct {
+    char* data;
+    size_t size, max;
+    int lost;
+} TraceBuffer;
+
+static TraceBuffer traceBuffer;
+
+static ssize_t WriteTrace (void* cookie, const char* data, size_t n) {
+    TraceBuffer* t = cookie;
+    if (t->lost || t->size + n > MAXTRACE) {
+        t->lost = TRUE;
+        return n;
+    }
+    if (t->size + n > t->max) {
+        t->max = 2*(t->size + n);
+        t->data = realloc (t->data, t->max);
+        if (t->data == NULL) {
+            fprintf (stderr, "simd: out of memory.\n");
+            exit (1);
+        }
+    }
+    memcpy (t->data+t->size, data, n);
+    t->size += n;
+    return n;
+}
+
+/* An empty trace, written through a stream for the event sinks */
+static FILE* OpenTrace () {
+    cookie_io_functions_t io = { NULL, WriteTrace, NULL, NULL };
+    traceBuffer.size = 0;
+    traceBuffer.lost = FALSE;
+    return fopencookie (&traceBuffer, "w", io);
+}
+
+static void AppendHeader (uint32_t type, size_t length) {
+    FrameHeader h;
+    h.type = type;
+    h.length = length;
+    Append (&h, sizeof(h));
+}
+
+static int ReadAll (int fd, void* buf, size_t n) {
+    ssize_t got;
+    while (n > 0) {
+        got = read (fd, buf, n);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return FALSE;
+        }
+        buf = (char*)buf + got;
+        n -= got;
+    }
+    return TRUE;
+}
+
+static int WriteAll (int fd, const void* buf, size_t n) {
+    ssize_t put;
+    while (n > 0) {
+        put = write (fd, buf, n);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return FALSE;
+        }
+        buf = (const char*)buf + put;
+        n -= put;
+    }
+    return TRUE;
+}
+
+static int SendError (int fd, const char* message) {
+    replySize = 0;
+    AppendHeader (FRAME_ERROR, strlen (message));
+    Append (message, strlen (message));
+    return WriteAll (fd, reply, replySize);
+}
+
+/*
+ *  Run the program in a FRAME_RUN payload and send back its trace, if
+ *  one was asked for, and its result.
+ */
+static int HandleRun (int fd, char* payload, size_t length) {
+    RunRequest request;
+    RunResult result;
+    ResultWord word;
+    FILE* trace = NULL;
+    int trap, k;
+    long long count;
+    const char* output;
+    size_t outputSize;
+
+    memcpy (&request, payload, sizeof(request));
+    if (request.trace > TRACE_BIN) {
+        return SendError (fd, "Unknown trace format.");
+    }
+    if (!LoadProgram (payload + sizeof(request), length - sizeof(request))) {
+        return SendError (fd, "Program too big.");
+    }
+    ClearEventSinks ();
+    if (request.trace != TRACE_NONE) {
+        trace = OpenTrace ();
+        if (trace == NULL) {
+            return SendError (fd, "No memory for the trace.");
+        }
+        AddStreamSink (request.trace == TRACE_BIN ? "bin" : "json", trace);
+    }
+
+    result.status = RunProgram (request.budget != 0 ? request.budget : defaultBudget,
+        &trap, &count);
+    output = TakeOutput (&outputSize);
+    if (trace != NULL) {
+        fclose (trace);
+    }
+    if (output == NULL) {
+        return SendError (fd, "Too much output.");
+    }
+    if (trace != NULL && traceBuffer.lost) {
+        return SendError (fd, "Trace too large.");
+    }
+    result.trap = trap;
+    result.pc = mips.pc;
+    result.retired = count;
+    memcpy (result.registers, mips.registers, sizeof(result.registers));
+    result.numWords = 0;
+    for (k=NextNonzeroWord(0); k >= 0; k=NextNonzeroWord(k+1)) {
+        result.numWords++;
+    }
+
+    replySize = 0;
+    if (trace != NULL) {
+        AppendHeader (FRAME_TRACE, traceBuffer.size);
+        Append (traceBuffer.data, traceBuffer.size);
+    }
+    if (outputSize != 0) {
+        AppendHeader (FRAME_OUTPUT, outputSize);
+        Append (output, outputSize);
+    }
+    AppendHeader (FRAME_RESULT, sizeof(result) + result.numWords*sizeof(word));
+    Append (&result, sizeof(result));
+    for (k=NextNonzeroWord(0); k >= 0; k=NextNonzeroWord(k+1)) {
+        word.addr = 0x00400000 + 4*k;
+        word.value = mips.memory[k];
+        Append (&word, sizeof(word));
+    }
+    return WriteAll (fd, reply, replySize);
+}
+
+/* Serve requests on one connection until the client closes it. */
+static void Connection (int fd) {
+    static char payload[MAXFRAME];
+    FrameHeader h;
+
+    while (ReadAll (fd, &h, sizeof(h))) {
+        if (h.length > MAXFRAME) {
+            SendError (fd, "Frame too big.");
+            return;
+        }
+        if (!ReadAll (fd, payload, h.length)) {
+            return;
+        }
+        if (h.type != FRAME_RUN || h.length < sizeof(RunRequest)) {
+            if (!SendError (fd, "Expected a run frame.")) {
+                return;
+            }
+        } else if (!HandleRun (fd, payload, h.length)) {
+            return;
+        }
+    }
+}
+
+static void Worker (int listener) {
+    int fd;
+
+    signal (SIGPIPE, SIG_IGN);     /* a client hanging up just ends its connection */
+    while (1) {
+        fd = accept (listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror ("simd: accept");
+            exit (1);
+        }
+        Connection (fd);
+        close (fd);
+    }
+}
+
+static void StartWorker (int listener) {
+    pid_t pid = fork ();
+    if (pid < 0) {
+        perror ("simd: fork");
+        exit (1);
+    }
+    if (pid == 0) {
+        Worker (listener);
+    }
+}
+
+/*
+ *  Listen on the Unix domain socket at path with the given number of
+ *  worker processes, all accepting connections on it, and replace any
+ *  that die. budget applies to requests that don't set their own;
+ *  if it is 0 they get DEFAULTBUDGET, so no run can go on forever.
+ *  Never returns.
+ */
+void Serve (const char* path, int workers, long long budget) {
+    struct sockaddr_un addr;
+    int listener, k;
+
+    defaultBudget = budget != 0 ? budget : DEFAULTBUDGET;
+    if (workers <= 0) {
+        workers = sysconf (_SC_NPROCESSORS_ONLN);
+    }
+    memset (&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen (path) >= sizeof(addr.sun_path)) {
+        fprintf (stderr, "Socket path too long: %s\n", path);
+        exit (1);
+    }
+    strcpy (addr.sun_path, path);
+    listener = socket (AF_UNIX, SOCK_STREAM, 0);
+    unlink (path);
+    if (listener < 0 || bind (listener, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen (listener, 128) != 0) {
+        perror ("simd");
+        exit (1);
+    }
+
+    /* warm up the computer once; workers inherit it */
+    LoadProgram ("", 0);
+    CaptureOutput (MAXOUTPUT);
+    for (k=0; k<workers; k++) {
+        StartWorker (listener);
+    }
+    while (1) {
+        if (wait (NULL) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror ("simd: wait");
+            exit (1);
+        }
+        StartWorker (listener);
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ *  simd: a pool of simulator processes serving runs over a Unix domain
+ *  socket (sim -S path). Each worker loads the program once per
+ *  request into its already initialized computer, so a run costs
+ *  neither a process start nor clearing all of memory.
+ *
+ *  Every message is a frame: a FrameHeader followed by length bytes of
+ *  payload, all in host byte order. A client sends FRAME_RUN frames on
+ *  a connection and gets back, for each, an optional FRAME_TRACE, a
+ *  FRAME_OUTPUT if the program printed anything and then a
+ *  FRAME_RESULT, or a FRAME_ERROR. read_int sees no input. A run that
+ *  prints more than MAXOUTPUT bytes, or whose trace is longer than
+ *  MAXTRACE bytes, gets a FRAME_ERROR instead, and one that sets no
+ *  budget runs at most DEFAULTBUDGET instructions unless the server
+ *  was given its own budget.
+ *
+ *    FRAME_RUN     RunRequest, then the program in .dump format
+ *    FRAME_TRACE   the event trace, as written by -e json or -e bin
+ *    FRAME_RESULT  RunResult, then numWords ResultWords
+ *    FRAME_ERROR   a message, not NUL terminated
+ *    FRAME_OUTPUT  what the program printed through syscalls
+ */
+
+#define FRAME_RUN 1
+#define FRAME_TRACE 2
+#define FRAME_RESULT 3
+#define FRAME_ERROR 4
+#define FRAME_OUTPUT 5
+
+#define TRACE_NONE 0
+#define TRACE_JSON 1
+#define TRACE_BIN 2
+
+#define MAXFRAME (1<<20)        /* largest payload accepted */
+#define MAXOUTPUT (1<<20)       /* most program output returned */
+#define MAXTRACE (64<<20)       /* longest trace returned */
+#define DEFAULTBUDGET 100000000LL   /* instructions, if no budget is set */
+
+typedef struct {
+    uint32_t type;
+    uint32_t length;            /* bytes of payload */
+} FrameHeader;
+
+typedef struct {
+    uint32_t trace;             /* TRACE_NONE, TRACE_JSON or TRACE_BIN */
+    uint32_t reserved;
+    int64_t budget;             /* instruction budget, 0 for the server's */
+} RunRequest;
+
+typedef struct {
+    int32_t status;             /* exit status sim would have had */
+    int32_t trap;               /* TrapKind that stopped it, or -1 */
+    uint32_t pc;
+    uint32_t numWords;          /* nonzero data words that follow */
+    int64_t retired;            /* instructions executed */
+    int32_t registers[32];
+} RunResult;
+
+typedef struct {
+    uint32_t addr;
+    int32_t value;
+} ResultWord;
+
+void Serve (const char* path, int workers, long long budget);
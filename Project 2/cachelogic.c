@@ -1,5 +1,17 @@
 #include "tips.h"
 
+/* Marks the end of the LFU lists */
+#define NONE 0xff
+
+/* BIP and BRRIP insert one block in this many as if it will be used soon */
+#define BIMODAL_RATE 32
+
+/* Leader sets for each of the two policies DRRIP and DIP duel between */
+#define MAX_LEADERS 32
+
+/* Fills made by BIP and BRRIP since the cache was flushed */
+static unsigned int bimodal_fills;
+
 /* The following two functions are defined in util.c */
 
 /* finds the highest 1 bit, and returns its position, else 0xFFFFFFFF */
@@ -19,8 +31,8 @@ int randomint( int x );
 char* lfu_to_string(int assoc_index, int block_index)
 {
   /* Buffer to print lfu information -- increase size as needed. */
-  static char buffer[9];
-  sprintf(buffer, "%u", cache[assoc_index].block[block_index].accessCount);
+  static char buffer[11];
+  sprintf(buffer, "%u", BLOCK(assoc_index, block_index).accessCount);
 
   return buffer;
 }
@@ -36,8 +48,31 @@ char* lfu_to_string(int assoc_index, int block_index)
 char* lru_to_string(int assoc_index, int block_index)
 {
   /* Buffer to print lru information -- increase size as needed. */
-  static char buffer[9];
-  sprintf(buffer, "%u", cache[assoc_index].block[block_index].lru.value);
+  static char buffer[11];
+  unsigned int rank = 0;
+  unsigned int a;
+
+  switch(policy)
+  {
+  case PLRU:
+    //the tree bits belong to the whole set
+    sprintf(buffer, "%x", cache_set[assoc_index].plru);
+    break;
+  case BIT_PLRU:
+    sprintf(buffer, "%u", (cache_set[assoc_index].plru >> block_index) & 1);
+    break;
+  case SRRIP:
+  case BRRIP:
+  case DRRIP:
+    sprintf(buffer, "%u", BLOCK(assoc_index, block_index).rrpv);
+    break;
+  default:
+    //how many blocks were used more recently
+    for(a = cache_set[assoc_index].mru; a != block_index; a = BLOCK(assoc_index, a).older)
+      rank++;
+    sprintf(buffer, "%u", rank);
+    break;
+  }
 
   return buffer;
 }
@@ -51,7 +86,17 @@ char* lru_to_string(int assoc_index, int block_index)
 */
 void init_lfu(int assoc_index, int block_index)
 {
-  cache[assoc_index].block[block_index].accessCount = 0;
+  cacheSet* set = &cache_set[assoc_index];
+
+  BLOCK(assoc_index, block_index).accessCount = 0;
+
+  //no bucket is in use yet; they all go on the free list
+  if(block_index == 0){
+    set->lfu_least = NONE;
+    set->lfu_free = 0;
+    set->lfu_accesses = 0;
+  }
+  BUCKET(assoc_index, block_index).higher = block_index + 1 < assoc ? block_index + 1 : NONE;
 }
 
 /*
@@ -63,7 +108,732 @@ void init_lfu(int assoc_index, int block_index)
 */
 void init_lru(int assoc_index, int block_index)
 {
-  cache[assoc_index].block[block_index].lru.value = 0;
+  cacheSet* set = &cache_set[assoc_index];
+
+  BLOCK(assoc_index, block_index).rrpv = RRPV_MAX;
+
+  //with the same next use, the blocks in order make a heap
+  BLOCK(assoc_index, block_index).next_use = 0;
+  BLOCK(assoc_index, block_index).opt_place = block_index;
+  HEAP(assoc_index, block_index) = block_index;
+
+  if(assoc_index == 0 && block_index == 0)
+    bimodal_fills = 0;
+
+  //the blocks start out in the recency list in order, block 0 the most recent
+  if(block_index == 0){
+    set->mru = 0;
+    set->lru = 0;
+    set->plru = 0;
+  }
+  else{
+    BLOCK(assoc_index, set->lru).older = block_index;
+    BLOCK(assoc_index, block_index).newer = set->lru;
+    set->lru = block_index;
+  }
+}
+
+/* returns a mask with a bit for each block of a set */
+static unsigned int all_ways(void)
+{
+  return assoc < 32 ? (1u << assoc) - 1 : ~0u;
+}
+
+/* returns the number of leaves of the PLRU tree, assoc rounded up to a power of two */
+static unsigned int plru_leaves(void)
+{
+  return assoc > 1 ? 1u << (32 - __builtin_clz(assoc - 1)) : 1;
+}
+
+/*
+  This function moves a block to the front of its set's recency list,
+  which takes the same few steps however many blocks the set has
+
+    index_v - the set that holds the block
+    a - the block that was used
+ */
+static void move_to_front(unsigned int index_v, unsigned int a)
+{
+  cacheSet* set = &cache_set[index_v];
+  cacheBlock* block = &BLOCK(index_v, a);
+
+  if(set->mru == a)
+    return;
+
+  //take the block out of the list
+  BLOCK(index_v, block->newer).older = block->older;
+  if(set->lru == a)
+    set->lru = block->newer;
+  else
+    BLOCK(index_v, block->older).newer = block->newer;
+
+  //and put it back at the front
+  block->older = set->mru;
+  BLOCK(index_v, set->mru).newer = a;
+  set->mru = a;
+}
+
+/*
+  This function moves a block to the back of its set's recency list, so
+  it is the next to be replaced
+
+    index_v - the set that holds the block
+    a - the block to move
+ */
+static void move_to_back(unsigned int index_v, unsigned int a)
+{
+  cacheSet* set = &cache_set[index_v];
+  cacheBlock* block = &BLOCK(index_v, a);
+
+  if(set->lru == a)
+    return;
+
+  //take the block out of the list
+  BLOCK(index_v, block->older).newer = block->newer;
+  if(set->mru == a)
+    set->mru = block->older;
+  else
+    BLOCK(index_v, block->newer).older = block->older;
+
+  //and put it back at the end
+  block->newer = set->lru;
+  BLOCK(index_v, set->lru).older = a;
+  set->lru = a;
+}
+
+/*
+  This function points every node of the PLRU tree on the way to a block
+  away from it. Node n has children 2n and 2n + 1, and its bit is 1 if the
+  next victim is on the right.
+
+    index_v - the set that holds the block
+    a - the block that was used
+ */
+static void touch_plru(unsigned int index_v, unsigned int a)
+{
+  unsigned int bits = cache_set[index_v].plru;
+  unsigned int node = 1;
+  unsigned int first = 0;
+  unsigned int half = plru_leaves();
+
+  while(half > 1){
+    half >>= 1;
+    if(a < first + half){
+      bits |= 1u << node;
+      node = 2 * node;
+    }
+    else{
+      bits &= ~(1u << node);
+      first += half;
+      node = 2 * node + 1;
+    }
+  }
+  cache_set[index_v].plru = bits;
+}
+
+/*
+  This function follows the PLRU tree to the block it points to, keeping
+  to the left where the right holds no blocks because assoc isn't a power
+  of two
+
+    index_v - the set to choose from
+
+  returns the block to replace
+ */
+static unsigned int plru_victim(unsigned int index_v)
+{
+  unsigned int bits = cache_set[index_v].plru;
+  unsigned int node = 1;
+  unsigned int first = 0;
+  unsigned int half = plru_leaves();
+
+  while(half > 1){
+    half >>= 1;
+    if(((bits >> node) & 1) && first + half < assoc){
+      first += half;
+      node = 2 * node + 1;
+    }
+    else
+      node = 2 * node;
+  }
+  return first;
+}
+
+/*
+  This function sets a block's recently used bit; once every block's bit
+  is set, the others are cleared
+
+    index_v - the set that holds the block
+    a - the block that was used
+ */
+static void touch_bit_plru(unsigned int index_v, unsigned int a)
+{
+  unsigned int bits = cache_set[index_v].plru | (1u << a);
+
+  if(bits == all_ways())
+    bits = 1u << a;
+  cache_set[index_v].plru = bits;
+}
+
+/*
+  This function puts a block at the most recently used end of an LFU bucket
+
+    index_v - the set that holds the block
+    b - the bucket
+    a - the block
+ */
+static void bucket_push(unsigned int index_v, unsigned int b, unsigned int a)
+{
+  lfuBucket* bucket = &BUCKET(index_v, b);
+  cacheBlock* block = &BLOCK(index_v, a);
+
+  block->lfu_bucket = b;
+  block->lfu_newer = NONE;
+  block->lfu_older = bucket->mru;
+  if(bucket->mru != NONE)
+    BLOCK(index_v, bucket->mru).lfu_newer = a;
+  else
+    bucket->lru = a;
+  bucket->mru = a;
+}
+
+/*
+  This function takes a block out of its LFU bucket, which may leave the
+  bucket empty
+
+    index_v - the set that holds the block
+    a - the block
+ */
+static void bucket_unlink(unsigned int index_v, unsigned int a)
+{
+  cacheBlock* block = &BLOCK(index_v, a);
+  lfuBucket* bucket = &BUCKET(index_v, block->lfu_bucket);
+
+  if(block->lfu_newer != NONE)
+    BLOCK(index_v, block->lfu_newer).lfu_older = block->lfu_older;
+  else
+    bucket->mru = block->lfu_older;
+  if(block->lfu_older != NONE)
+    BLOCK(index_v, block->lfu_older).lfu_newer = block->lfu_newer;
+  else
+    bucket->lru = block->lfu_newer;
+}
+
+/*
+  This function takes an empty bucket off the free list and links it in
+  between two buckets
+
+    index_v - the set
+    count - the access count of the bucket's blocks
+    lower, higher - its neighbours, either of which may be NONE
+
+  returns the bucket
+ */
+static unsigned int new_bucket(unsigned int index_v, int count, unsigned int lower, unsigned int higher)
+{
+  cacheSet* set = &cache_set[index_v];
+  unsigned int b = set->lfu_free;
+  lfuBucket* bucket = &BUCKET(index_v, b);
+
+  set->lfu_free = bucket->higher;
+  bucket->count = count;
+  bucket->mru = NONE;
+  bucket->lru = NONE;
+  bucket->lower = lower;
+  bucket->higher = higher;
+  if(lower != NONE)
+    BUCKET(index_v, lower).higher = b;
+  else
+    set->lfu_least = b;
+  if(higher != NONE)
+    BUCKET(index_v, higher).lower = b;
+  return b;
+}
+
+/*
+  This function unlinks a bucket and returns it to the free list
+
+    index_v - the set
+    b - the bucket
+ */
+static void free_bucket(unsigned int index_v, unsigned int b)
+{
+  cacheSet* set = &cache_set[index_v];
+  lfuBucket* bucket = &BUCKET(index_v, b);
+
+  if(bucket->lower != NONE)
+    BUCKET(index_v, bucket->lower).higher = bucket->higher;
+  else
+    set->lfu_least = bucket->higher;
+  if(bucket->higher != NONE)
+    BUCKET(index_v, bucket->higher).lower = bucket->lower;
+  bucket->higher = set->lfu_free;
+  set->lfu_free = b;
+}
+
+/*
+  This function takes a block that is being replaced out of the LFU
+  buckets
+
+    index_v - the set that holds the block
+    a - the block
+ */
+static void lfu_remove(unsigned int index_v, unsigned int a)
+{
+  unsigned int b = BLOCK(index_v, a).lfu_bucket;
+
+  bucket_unlink(index_v, a);
+  if(BUCKET(index_v, b).mru == NONE)
+    free_bucket(index_v, b);
+}
+
+/*
+  This function puts a block that was just brought in, whose count is the
+  smallest there can be, into the LFU buckets
+
+    index_v - the set that holds the block
+    a - the block
+ */
+static void lfu_insert(unsigned int index_v, unsigned int a)
+{
+  int count = BLOCK(index_v, a).accessCount;
+  unsigned int least = cache_set[index_v].lfu_least;
+  unsigned int b;
+
+  if(least != NONE && BUCKET(index_v, least).count == count)
+    b = least;
+  else
+    b = new_bucket(index_v, count, NONE, least);
+  bucket_push(index_v, b, a);
+}
+
+/*
+  This function moves a block whose count just went up by one into the
+  next bucket. Each bucket's blocks are in the order they came into it,
+  which is the order they were last used, so the least recently used
+  block of the lowest bucket is the one to replace.
+
+    index_v - the set that holds the block
+    a - the block
+ */
+static void lfu_promote(unsigned int index_v, unsigned int a)
+{
+  int count = BLOCK(index_v, a).accessCount;
+  unsigned int b = BLOCK(index_v, a).lfu_bucket;
+  unsigned int higher = BUCKET(index_v, b).higher;
+  unsigned int target;
+
+  bucket_unlink(index_v, a);
+  if(higher != NONE && BUCKET(index_v, higher).count == count)
+    target = higher;
+  else if(BUCKET(index_v, b).mru == NONE){
+    //the block was alone, so its bucket can move up with it
+    BUCKET(index_v, b).count = count;
+    target = b;
+  }
+  else
+    target = new_bucket(index_v, count, b, higher);
+
+  if(target != b && BUCKET(index_v, b).mru == NONE)
+    free_bucket(index_v, b);
+  bucket_push(index_v, target, a);
+}
+
+/*
+  This function moves the blocks of one bucket into another, keeping them
+  in the order they were last used
+
+    index_v - the set
+    into, from - the buckets; from is freed
+    rank - for each block, how many blocks were used more recently
+ */
+static void merge_buckets(unsigned int index_v, unsigned int into, unsigned int from, const unsigned char* rank)
+{
+  unsigned int a = BUCKET(index_v, into).lru;
+  unsigned int b = BUCKET(index_v, from).lru;
+  unsigned int next;
+
+  BUCKET(index_v, into).mru = NONE;
+  BUCKET(index_v, into).lru = NONE;
+  while(a != NONE || b != NONE){
+    //the one used longer ago goes first
+    if(b == NONE || (a != NONE && rank[a] > rank[b])){
+      next = BLOCK(index_v, a).lfu_newer;
+      bucket_push(index_v, into, a);
+      a = next;
+    }
+    else{
+      next = BLOCK(index_v, b).lfu_newer;
+      bucket_push(index_v, into, b);
+      b = next;
+    }
+  }
+  free_bucket(index_v, from);
+}
+
+/*
+  This function halves the access counts of a set every lfu_aging
+  accesses to it, so blocks that were used heavily long ago don't stay
+  forever. Counts round up, keeping them above zero; buckets that end up
+  with the same count are merged.
+
+    index_v - the set
+ */
+static void lfu_age(unsigned int index_v)
+{
+  cacheSet* set = &cache_set[index_v];
+  unsigned char rank[MAX_ASSOC];
+  unsigned int a;
+  unsigned int b;
+  unsigned int next;
+  unsigned int n = 0;
+
+  if(lfu_aging == 0 || ++set->lfu_accesses < lfu_aging)
+    return;
+  set->lfu_accesses = 0;
+
+  for(a = set->mru; n < assoc; a = BLOCK(index_v, a).older)
+    rank[a] = n++;
+  for(a = 0; a < assoc; a++)
+    BLOCK(index_v, a).accessCount = (BLOCK(index_v, a).accessCount + 1) / 2;
+
+  for(b = set->lfu_least; b != NONE; b = next){
+    next = BUCKET(index_v, b).higher;
+    BUCKET(index_v, b).count = (BUCKET(index_v, b).count + 1) / 2;
+    if(BUCKET(index_v, b).lower != NONE && BUCKET(index_v, BUCKET(index_v, b).lower).count == BUCKET(index_v, b).count)
+      merge_buckets(index_v, BUCKET(index_v, b).lower, b, rank);
+  }
+}
+
+/*
+  This function moves a block whose next use has changed to its place in
+  its set's OPT heap, where each block is used no sooner than the blocks
+  below it: entry i has children 2i + 1 and 2i + 2.
+
+    index_v - the set that holds the block
+    a - the block
+ */
+static void opt_sift(unsigned int index_v, unsigned int a)
+{
+  unsigned long long next_use = BLOCK(index_v, a).next_use;
+  unsigned int place = BLOCK(index_v, a).opt_place;
+  unsigned int parent, child;
+
+  //up past the blocks used sooner
+  while(place > 0){
+    parent = (place - 1) / 2;
+    if(BLOCK(index_v, HEAP(index_v, parent)).next_use >= next_use)
+      break;
+    HEAP(index_v, place) = HEAP(index_v, parent);
+    BLOCK(index_v, HEAP(index_v, place)).opt_place = place;
+    place = parent;
+  }
+
+  //or down past the blocks used later
+  while((child = 2 * place + 1) < assoc){
+    if(child + 1 < assoc && BLOCK(index_v, HEAP(index_v, child + 1)).next_use > BLOCK(index_v, HEAP(index_v, child)).next_use)
+      child++;
+    if(BLOCK(index_v, HEAP(index_v, child)).next_use <= next_use)
+      break;
+    HEAP(index_v, place) = HEAP(index_v, child);
+    BLOCK(index_v, HEAP(index_v, place)).opt_place = place;
+    place = child;
+  }
+
+  HEAP(index_v, place) = a;
+  BLOCK(index_v, a).opt_place = place;
+}
+
+/*
+  This function tells which of the two dueling policies a set leads for,
+  if either. A quarter of the sets, up to MAX_LEADERS, lead for each. The
+  sets are split into runs of "stride", and run n has the leaders at
+  n % stride and stride - 1 - n % stride, so they are spread over the
+  cache and not all at the same place in their runs.
+
+    index_v - the set
+
+  returns FIRST_LEADER, SECOND_LEADER or FOLLOWER
+ */
+static DuelRole duel_role(unsigned int index_v)
+{
+  unsigned int leaders = set_count / 4 < MAX_LEADERS ? set_count / 4 : MAX_LEADERS;
+  unsigned int stride, place, run;
+
+  //too few sets to spare any
+  if(leaders == 0)
+    return FOLLOWER;
+
+  stride = set_count / leaders;
+  place = index_v & (stride - 1);
+  run = (index_v / stride) & (stride - 1);
+  if(place == run)
+    return FIRST_LEADER;
+  if(place == stride - 1 - run)
+    return SECOND_LEADER;
+  return FOLLOWER;
+}
+
+/* returns TRUE if set index_v uses the second of the dueling policies, BRRIP or BIP */
+static int second_policy(unsigned int index_v)
+{
+  switch(duel_role(index_v))
+  {
+  case FIRST_LEADER:
+    return 0;
+  case SECOND_LEADER:
+    return 1;
+  default:
+    return cache_stats.psel > PSEL_MAX / 2;
+  }
+}
+
+/* returns TRUE for the one insertion in BIMODAL_RATE that BIP and BRRIP make as if the block will be used soon */
+static int bimodal_near(void)
+{
+  return ++bimodal_fills % BIMODAL_RATE == 0;
+}
+
+/*
+  This function picks the RRPV a block just brought in starts with:
+  SRRIP predicts it will be used after a long while, RRPV_MAX - 1, and
+  BRRIP mostly predicts it won't be used at all
+
+    index_v - the set that holds the block
+
+  returns the block's RRPV
+ */
+static unsigned char insertion_rrpv(unsigned int index_v)
+{
+  if(policy == SRRIP || (policy == DRRIP && !second_policy(index_v)))
+    return RRPV_MAX - 1;
+  return bimodal_near() ? RRPV_MAX - 1 : RRPV_MAX;
+}
+
+/*
+  This function chooses the RRIP victim, the first block predicted not to
+  be used at all. If there is none, every block's RRPV is raised by as
+  much as it takes for there to be one, which is the same as raising
+  them all by one until there is.
+
+    index_v - the set to choose from
+
+  returns the block to replace
+ */
+static unsigned int rrip_victim(unsigned int index_v)
+{
+  unsigned int victim = 0;
+  unsigned int a;
+  unsigned char oldest = 0;
+
+  for(a = 0; a < assoc; a++){
+    if(BLOCK(index_v, a).rrpv > oldest){
+      oldest = BLOCK(index_v, a).rrpv;
+      victim = a;
+    }
+  }
+  if(oldest < RRPV_MAX){
+    for(a = 0; a < assoc; a++)
+      BLOCK(index_v, a).rrpv += RRPV_MAX - oldest;
+  }
+  return victim;
+}
+
+/*
+  This function counts an access for print_stats(), and for DRRIP and DIP
+  moves the policy selector after a miss in a leader set
+
+    index_v - the set that was accessed
+    action - HIT or MISS
+ */
+static void count_access(unsigned int index_v, CacheAction action)
+{
+  DuelRole role;
+
+  cache_stats.accesses++;
+  if(action == MISS)
+    cache_stats.misses++;
+  if(policy != DRRIP && policy != DIP)
+    return;
+
+  role = duel_role(index_v);
+  cache_stats.duel_accesses[role]++;
+  if(action == HIT)
+    return;
+  cache_stats.duel_misses[role]++;
+  if(role == FIRST_LEADER && cache_stats.psel < PSEL_MAX)
+    cache_stats.psel++;
+  else if(role == SECOND_LEADER && cache_stats.psel > 0)
+    cache_stats.psel--;
+}
+
+/*
+  This function records that a block was used, for the replacement policy
+
+    index_v - the set that holds the block
+    a - the block that was used
+    action - MISS if the block was just brought in
+ */
+static void touch_block(unsigned int index_v, unsigned int a, CacheAction action)
+{
+  //BIP puts most new blocks at the LRU end, where they go next unless used again
+  if(policy == DIP && action == MISS && second_policy(index_v) && !bimodal_near())
+    move_to_back(index_v, a);
+  else
+    move_to_front(index_v, a);
+  BLOCK(index_v, a).accessCount++;
+  switch(policy)
+  {
+  case LFU:
+    if(action == MISS)
+      lfu_insert(index_v, a);
+    else
+      lfu_promote(index_v, a);
+    lfu_age(index_v);
+    break;
+  case PLRU:
+    touch_plru(index_v, a);
+    break;
+  case BIT_PLRU:
+    touch_bit_plru(index_v, a);
+    break;
+  case SRRIP:
+  case BRRIP:
+  case DRRIP:
+    BLOCK(index_v, a).rrpv = action == MISS ? insertion_rrpv(index_v) : 0;
+    break;
+  case OPT:
+    BLOCK(index_v, a).next_use = opt_next_use;
+    opt_sift(index_v, a);
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+  This function compares a tag with the tags of all the blocks of a set,
+  one at a time
+
+    tags - the tags of the set's blocks
+    tag_v - the tag to look for
+
+  returns a mask with bit a set if block a has the tag
+ */
+static unsigned int match_tags_scalar(const unsigned int* tags, unsigned int tag_v)
+{
+  unsigned int hits = 0;
+  unsigned int a;
+
+  for(a = 0; a < assoc; a++)
+    hits |= (unsigned int)(tags[a] == tag_v) << a;
+  return hits;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/*
+  This function does the same as match_tags_scalar() eight blocks at a
+  time, so it takes one compare for up to 8 ways and two for up to 16.
+  It may read past the set's last tag, which cache_tag's padding allows;
+  those bits are dropped by the valid mask.
+ */
+__attribute__((target("avx2")))
+static unsigned int match_tags_avx2(const unsigned int* tags, unsigned int tag_v)
+{
+  __m256i wanted = _mm256_set1_epi32(tag_v);
+  __m256i same;
+  unsigned int hits = 0;
+  unsigned int a;
+
+  for(a = 0; a < assoc; a += 8)
+  {
+    same = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags + a)), wanted);
+    hits |= (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(same)) << a;
+  }
+  return hits;
+}
+#endif
+
+/* The tag compare to use, chosen for this CPU on the first access */
+static unsigned int (*match_tags)(const unsigned int* tags, unsigned int tag_v);
+
+/*
+  This function looks for a block in a set
+
+    index_v - the set to search
+    tag_v - the tag of the block
+
+  returns the block's index in the set, or assoc if it isn't there
+ */
+static unsigned int find_block(unsigned int index_v, unsigned int tag_v)
+{
+  unsigned int hits;
+
+  if(match_tags == NULL)
+  {
+    match_tags = match_tags_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    if(__builtin_cpu_supports("avx2"))
+      match_tags = match_tags_avx2;
+#endif
+  }
+
+  hits = match_tags(&BLOCK_TAG(index_v, 0), tag_v) & cache_valid[index_v];
+  return hits != 0 ? __builtin_ctz(hits) : assoc;
+}
+
+/*
+  This function chooses the block of a set to replace, an invalid one
+  if there is one and otherwise the one the policy picks
+
+    index_v - the set that needs a block
+
+  returns the index of the block to replace
+ */
+static unsigned int choose_victim(unsigned int index_v)
+{
+  unsigned int invalid = ~cache_valid[index_v] & all_ways();
+  unsigned int unused;
+  unsigned int victim = 0;
+
+  if(invalid != 0)
+    return __builtin_ctz(invalid);
+
+  switch(policy)
+  {
+  case RANDOM:
+    victim = randomint(assoc);
+    break;
+  case LRU:
+  case DIP:
+    victim = cache_set[index_v].lru;
+    break;
+  case PLRU:
+    victim = plru_victim(index_v);
+    break;
+  case LFU:
+    victim = BUCKET(index_v, cache_set[index_v].lfu_least).lru;
+    break;
+  case BIT_PLRU:
+    //the first block whose bit is clear; with one block its bit never is
+    unused = ~cache_set[index_v].plru & all_ways();
+    victim = unused != 0 ? __builtin_ctz(unused) : 0;
+    break;
+  case SRRIP:
+  case BRRIP:
+  case DRRIP:
+    victim = rrip_victim(index_v);
+    break;
+  case OPT:
+    //the block used furthest in the future, if at all
+    victim = HEAP(index_v, 0);
+    break;
+  default:
+    break;
+  }
+  return victim;
 }
 
 /*
@@ -81,23 +851,21 @@ void init_lru(int assoc_index, int block_index)
 void accessMemory(address addr, word* data, WriteEnable we)
 {
   /* Declare variables here */
-  unsigned int tag_l, index_l, offset_l; //length of TIO
   unsigned int tag_v, index_v, offset_v; //values of TIO
-  enum cache_hit {Hit, Miss}; 
-  enum cache_hit cache_hit = Miss; //default it to miss
+  unsigned int block_location; //the block of the set that holds addr
+  CacheAction action = HIT;
   address wb_addr;
-  unsigned int block_location;
-  unsigned int LRU_v, random_v = 0;
 
   /* handle the case of no cache at all - leave this in */
-  if(assoc == 0) {
+  if(assoc == 0 || set_count == 0 || block_size == 0) {
     accessDRAM(addr, (byte*)data, WORD_SIZE, we);
     return;
   }
 
   /*
   You need to read/write between memory (via the accessDRAM() function) and
-  the cache (via the cache[] global structure defined in tips.h)
+  the cache (via the cache_tag[], cache_block[] and cache_data[] arrays and
+  the BLOCK macros defined in tips.h)
 
   Remember to read tips.h for all the global variables that tell you the
   cache parameters
@@ -123,278 +891,96 @@ void accessMemory(address addr, word* data, WriteEnable we)
   */
 
   /* Start adding code here */
-  index_l = uint_log2(set_count); //find length of index
-  offset_l = uint_log2(block_size); // find length of offset
-  tag_l = 32 - (index_l + offset_l); //find length of tag, which is remaining bits
-  //find tag_v
-  tag_v = addr >> (index_l + offset_l);
-  //find index_v
-  unsigned int temp_addr;
-  temp_addr = addr >> offset_l;
-  int binary_rep_for_index_l = 1;
-  for(int i = 0; i < offset_l; i++){
-    binary_rep_for_index_l = 2 * binary_rep_for_index_l;
-  }
-  binary_rep_for_index_l = binary_rep_for_index_l - 1;
-  index_v = temp_addr & binary_rep_for_index_l;
-  //find offset_v
-  int binary_rep_for_offset_l = 1;
-  for(int j = 0; j < offset_l; j++){
-    binary_rep_for_offset_l = 2 * binary_rep_for_offset_l;
+  //split the address with the shifts and masks worked out by config
+  tag_v = addr >> tag_shift;
+  index_v = (addr >> offset_bits) & index_mask;
+  offset_v = addr & offset_mask;
+
+  //go through all the blocks of the set and find if any block is the one we are looking for
+  block_location = find_block(index_v, tag_v);
+  if(block_location == assoc){
+    //miss: make room, writing the old block back if it was changed, and bring in the new one
+    action = MISS;
+    block_location = choose_victim(index_v);
+    if(BLOCK_VALID(index_v, block_location) && policy == LFU){
+      lfu_remove(index_v, block_location);
+    }
+    if(BLOCK_VALID(index_v, block_location) && BLOCK(index_v, block_location).dirty == DIRTY){
+      cache_stats.writebacks++;
+      wb_addr = (BLOCK_TAG(index_v, block_location) << tag_shift) | (index_v << offset_bits);
+      if(!trace_active)
+        accessDRAMBlock(wb_addr, BLOCK_DATA(index_v, block_location), block_size, WRITE);
+    }
+    //a trace has no memory behind it, and isn't drawn
+    if(!trace_active)
+      accessDRAMBlock(addr & ~offset_mask, BLOCK_DATA(index_v, block_location), block_size, READ);
+    BLOCK_TAG(index_v, block_location) = tag_v;
+    cache_valid[index_v] |= 1u << block_location;
+    BLOCK(index_v, block_location).dirty = VIRGIN;
+    BLOCK(index_v, block_location).accessCount = 0;
+    if(!trace_active)
+      highlight_block(index_v, block_location);
   }
-  binary_rep_for_offset_l = binary_rep_for_offset_l - 1 ;
-  offset_v = addr & binary_rep_for_offset_l;
-  
+
   switch (we){
     //handles Read
     case READ:
-    {
-      //go through all the block given the amount of assoc, and find if any block is the one we are looking for
-      for(unsigned int a = 0; a < assoc; a++){
-        if(cache[index_v].block[a].tag == tag_v && cache[index_v].block[a].valid == VALID){
-          cache_hit = Hit;
-          block_location = a;       
-        }
-      }
-      switch (cache_hit)
-      {
-        //handles read hit
-        case Hit:
-        {
-          cache[index_v].block[block_location].lru.value = 0;
-          cache[index_v].block[block_location].valid = VALID;
-          memcpy(data, (cache[index_v].block[block_location].data + offset_v), 4);
-          highlight_offset(index_v, block_location, offset_v, HIT);
-        }
-        break;
-        //handles read miss
-        case Miss:
-        {
-          //handles LRU cache miss policy
-          switch (policy)
-          {
-          case LRU:{
-            for(unsigned int c = 0; c < assoc; c++){
-              if(cache[index_v].block[c].lru.value > cache[index_v].block[LRU_v].lru.value){
-                LRU_v = c;
-              }
-            }
-            if(cache[index_v].block[LRU_v].dirty = DIRTY){
-              if(memory_sync_policy == WRITE_BACK){
-                wb_addr = cache[index_v].block[LRU_v].tag << (index_l + offset_l) + (index_v << offset_l);
-                accessDRAM(wb_addr, cache[index_v].block[LRU_v].data, offset_l, WRITE);
-              }
-              else if(memory_sync_policy == WRITE_THROUGH){
-                accessDRAM(addr, cache[index_v].block[LRU_v].data, offset_l, WRITE);
-              }
-            }
-            accessDRAM(addr, cache[index_v].block[LRU_v].data, offset_l, READ); //get data from memory
-            cache[index_v].block[LRU_v].tag = tag_v; //set all the values
-			      cache[index_v].block[LRU_v].valid = 1;
-            cache[index_v].block[LRU_v].lru.value = 0;
-            cache[index_v].block[LRU_v].dirty = VIRGIN;
-            memcpy(data, (cache[index_v].block[LRU_v].data + offset_v), 4); 
-            highlight_block(index_v, LRU_v);
-            highlight_offset(index_v, LRU_v, offset_v, MISS);
-          }
-          break;
-
-          //handle random cache miss policy
-          case RANDOM:
-          {
-            random_v = randomint(assoc);
-            if(cache[index_v].block[random_v].dirty = DIRTY){
-              if(memory_sync_policy == WRITE_BACK){
-                wb_addr = cache[index_v].block[random_v].tag << (index_l + offset_l) + (index_v << offset_l);
-                accessDRAM(wb_addr, cache[index_v].block[random_v].data, offset_l, WRITE);
-              }
-              else if(memory_sync_policy == WRITE_THROUGH){
-                accessDRAM(addr, cache[index_v].block[random_v].data, offset_l, WRITE);
-              }
-            }
-            accessDRAM(addr, cache[index_v].block[random_v].data, offset_l, READ);
-            cache[index_v].block[random_v].valid = 1;
-			      cache[index_v].block[random_v].lru.value = 0;
-            cache[index_v].block[random_v].tag = tag_v;
-            cache[index_v].block[random_v].dirty = VIRGIN;
-            memcpy(data, (cache[index_v].block[random_v].data + offset_v), 4); 
-            highlight_block(index_v, random_v);
-            highlight_offset(index_v, random_v, offset_v, MISS);
-          }
-          break;
-
-          default:
-          break;
-          }
-        }
-        break;
-      }
-    }
+      memcpy(data, BLOCK_DATA(index_v, block_location) + offset_v, 4);
     break;
     //handles Write
     case WRITE:
-      switch (memory_sync_policy)
-      {
-      case WRITE_BACK:
-          for(unsigned int a = 0; a < assoc; a++){
-           if(cache[index_v].block[a].tag == tag_v && cache[index_v].block[a].valid == VALID){
-            cache_hit = Hit;
-            block_location = a; 
-            }
-          }
-          switch (cache_hit)
-      {
-        //handles read hit
-        case Hit:
-        {
-          cache[index_v].block[block_location].lru.value = 0;
-          cache[index_v].block[block_location].valid = VALID;
-          cache[index_v].block[block_location].dirty = VIRGIN;
-          memcpy((cache[index_v].block[block_location].data + offset_v), data, 4);
-          accessDRAM(addr, cache[index_v].block[block_location].data, offset_l, WRITE);
-          highlight_offset(index_v, block_location, offset_v, HIT);
-        }
-        break;
-        //handles read miss
-        case Miss:
-        {
-          //handles LRU cache miss policy
-          switch (policy)
-          {
-          case LRU:
-          {
-            for(unsigned int c = 0; c < assoc; c++){
-              if(cache[index_v].block[c].lru.value > cache[index_v].block[LRU_v].lru.value){
-                LRU_v = c;
-              }
-            }
-            accessDRAM(addr, cache[index_v].block[LRU_v].data, offset_l, READ); 
-            cache[index_v].block[LRU_v].tag = tag_v;
-			      cache[index_v].block[LRU_v].valid = 1;
-            cache[index_v].block[LRU_v].lru.value = 0;
-            cache[index_v].block[LRU_v].dirty = VIRGIN;
-            memcpy(data, (cache[index_v].block[LRU_v].data + offset_v), 4); 
-            highlight_block(index_v, LRU_v);
-            highlight_offset(index_v, LRU_v, offset_v, MISS);
-            
-            if(cache[index_v].block[LRU_v].dirty = DIRTY){
-              if(memory_sync_policy == WRITE_BACK){
-                wb_addr = cache[index_v].block[LRU_v].tag << (index_l + offset_l) + (index_v << offset_l);
-                accessDRAM(wb_addr, cache[index_v].block[LRU_v].data, offset_l, WRITE);
-              }
-            }
-          }
-          break;
-
-          //handle random cache miss policy
-          case RANDOM:
-          {
-            random_v = randomint(assoc);
-            accessDRAM(addr, cache[index_v].block[random_v].data, offset_l, READ);
-            cache[index_v].block[random_v].valid = 1;
-			      cache[index_v].block[random_v].lru.value = 0;
-            cache[index_v].block[random_v].tag = tag_v;
-            cache[index_v].block[random_v].dirty = VIRGIN;
-            memcpy(data, (cache[index_v].block[random_v].data + offset_v), 4); 
-            highlight_block(index_v, random_v);
-            highlight_offset(index_v, random_v, offset_v, MISS);
-
-            if(cache[index_v].block[random_v].dirty = DIRTY){
-              if(memory_sync_policy == WRITE_BACK){
-                wb_addr = cache[index_v].block[random_v].tag << (index_l + offset_l) + (index_v << offset_l);
-                accessDRAM(wb_addr, cache[index_v].block[random_v].data, offset_l, WRITE);
-              }
-            }
-          }
-          break;
-
-          default:
-          break;
-          }
-        }
-        break;
+      memcpy(BLOCK_DATA(index_v, block_location) + offset_v, data, 4);
+      if(memory_sync_policy == WRITE_BACK){
+        BLOCK(index_v, block_location).dirty = DIRTY;
       }
-        break;
-      case WRITE_THROUGH:
-      //   for(unsigned int a = 0; a < assoc; a++){
-      //      if(cache[index_v].block[a].tag == tag_v && cache[index_v].block[a].valid == VALID){
-      //       cache_hit = Hit;
-      //       block_location = a; 
-      //       }
-      //     }
-      //     switch (cache_hit)
-      // {
-      //   //handles read hit
-      //   case Hit:
-      //   {
-      //     cache[index_v].block[block_location].lru.value = 0;
-      //     cache[index_v].block[block_location].valid = VALID;
-      //     cache[index_v].block[block_location].dirty = VIRGIN;
-      //     memcpy((cache[index_v].block[block_location].data + offset_v), data, 4);
-      //     accessDRAM(addr, cache[index_v].block[block_location].data, offset_l, WRITE);
-      //     highlight_offset(index_v, block_location, offset_v, HIT);
-      //   }
-      //   break;
-      //   //handles read miss
-      //   case Miss:
-      //   {
-      //     //handles LRU cache miss policy
-      //     switch (policy)
-      //     {
-      //     case LRU:
-      //     {
-      //       for(unsigned int c = 0; c < assoc; c++){
-      //         if(cache[index_v].block[c].lru.value > cache[index_v].block[LRU_v].lru.value){
-      //           LRU_v = c;
-      //         }
-      //       }
-      //       accessDRAM(addr, cache[index_v].block[LRU_v].data, offset_l, READ); 
-      //       cache[index_v].block[LRU_v].tag = tag_v;
-			//       cache[index_v].block[LRU_v].valid = 1;
-      //       cache[index_v].block[LRU_v].lru.value = 0;
-      //       cache[index_v].block[LRU_v].dirty = VIRGIN;
-      //       memcpy(data, (cache[index_v].block[LRU_v].data + offset_v), 4); 
-      //       highlight_block(index_v, LRU_v);
-      //       highlight_offset(index_v, LRU_v, offset_v, MISS);
-
-      //     }
-      //     break;
-
-      //     //handle random cache miss policy
-      //     case RANDOM:
-      //     {
-      //       random_v = randomint(assoc);
-      //       accessDRAM(addr, cache[index_v].block[random_v].data, offset_l, READ);
-      //       cache[index_v].block[random_v].valid = 1;
-			//       cache[index_v].block[random_v].lru.value = 0;
-      //       cache[index_v].block[random_v].tag = tag_v;
-      //       cache[index_v].block[random_v].dirty = VIRGIN;
-      //       memcpy(data, (cache[index_v].block[random_v].data + offset_v), 4); 
-      //       highlight_block(index_v, random_v);
-      //       highlight_offset(index_v, random_v, offset_v, MISS);
-
-      //     }
-      //     break;
-
-      //     default:
-      //     break;
-      //     }
-      //   }
-      //   break;//miss break
-      // }
-        break;//wt break
+      else if(!trace_active){
+        accessDRAM(addr, (byte*)data, WORD_SIZE, WRITE);
       }
-    break; //write break
+    break;
   }
+  if(!trace_active)
+    highlight_offset(index_v, block_location, offset_v, action);
+  count_access(index_v, action);
 
-  if(policy == LRU){
-      for(unsigned int i = 0; i < assoc; i++){
-        cache[index_v].block[i].lru.value = cache[index_v].block[i].lru.value + 1;
-      }
-  }
-  /* This call to accessDRAM occurs when you modify any of the
-     cache parameters. It is provided as a stop gap solution.
-     At some point, ONCE YOU HAVE MORE OF YOUR CACHELOGIC IN PLACE,
-     THIS LINE SHOULD BE REMOVED.
-  */
+  //the block just used is the most recently used one
+  touch_block(index_v, block_location, action);
+}
+
+/* prints one line of print_stats() for accesses of which misses missed */
+static void print_rate(const char* what, unsigned long long accesses, unsigned long long misses)
+{
+  char buffer[200];
+
+  sprintf(buffer, "%s: %llu accesses, %llu misses (%.2f%%)\n", what, accesses, misses,
+          accesses != 0 ? 100.0 * misses / accesses : 0.0);
+  append_log(buffer);
+}
+
+/*
+  This function prints how the cache has done since it was last flushed:
+  its miss rate and, for DRRIP and DIP, the miss rate of each policy's
+  leader sets and which policy the other sets are following
+ */
+void print_stats(void)
+{
+  char buffer[200];
+  char what[100];
+  const char* first = policy == DIP ? "LRU" : "SRRIP";
+  const char* second = policy == DIP ? "BIP" : "BRRIP";
+  const char* winner = cache_stats.psel > PSEL_MAX / 2 ? second : first;
+
+  print_rate("Cache", cache_stats.accesses, cache_stats.misses);
+  sprintf(buffer, "Write-backs: %llu\n", cache_stats.writebacks);
+  append_log(buffer);
+  if(policy != DRRIP && policy != DIP)
+    return;
+
+  sprintf(what, "%s leader sets", first);
+  print_rate(what, cache_stats.duel_accesses[FIRST_LEADER], cache_stats.duel_misses[FIRST_LEADER]);
+  sprintf(what, "%s leader sets", second);
+  print_rate(what, cache_stats.duel_accesses[SECOND_LEADER], cache_stats.duel_misses[SECOND_LEADER]);
+  sprintf(what, "Follower sets, now using %s", winner);
+  print_rate(what, cache_stats.duel_accesses[FOLLOWER], cache_stats.duel_misses[FOLLOWER]);
+  sprintf(buffer, "PSEL %u of %u: %s is winning\n", cache_stats.psel, PSEL_MAX, winner);
+  append_log(buffer);
 }
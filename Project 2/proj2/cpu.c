@@ -319,12 +319,16 @@ void execute_inst(word inst)
     sprintf(buffer, "Unsupported instruction, lbu\n");
     break;
   case 35: /* lw */
+    if(reuse_active)
+      record_reuse(rs + getSImmed(inst), PC - sizeof(instruction));
     accessMemory(rs + getSImmed(inst), &rt, READ);
     break;
   case 40: /* sb */
     sprintf(buffer, "Unsupported instruction, sb\n");
     break;
   case 43: /* sw */
+    if(reuse_active)
+      record_reuse(rs + getSImmed(inst), PC - sizeof(instruction));
     accessMemory(rs + getSImmed(inst), &rt, WRITE);
     break;
   case 63:
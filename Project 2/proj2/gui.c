@@ -56,9 +56,7 @@ GtkTextMark* mark;
 GtkWidget* assoc_entry;
 GtkWidget* index_entry;
 GtkWidget* block_entry;
-GtkWidget* random_policy_button;
-GtkWidget* lru_policy_button;
-GtkWidget* lfu_policy_button;
+GtkWidget* policy_button[NUM_POLICIES];
 ReplacementPolicy panel_replacement_policy;
 GtkWidget* write_back_policy_button;
 GtkWidget* write_through_policy_button;
@@ -331,7 +329,7 @@ void configure_cache_drawing_parameters(GtkWidget* widget)
 
   /* Init block header size information */
   block_header_text = "  %2d  %d %d %s\t%s\t%08X   ";
-  buffer_size = sprintf(buffer, block_header_text, 0, cache[0].block[0].valid, cache[0].block[0].dirty, lru_to_string(0, 0), lfu_to_string(0,0), cache[0].block[0].tag);
+  buffer_size = sprintf(buffer, block_header_text, 0, INVALID, VIRGIN, "0", "0", 0);
   pango_layout_set_text(layout, buffer, buffer_size);
   pango_layout_get_pixel_size(layout, &block_header_width, NULL);
 
@@ -417,7 +415,7 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
   {
     for(s = 0; s < assoc; s++)
     {
-      buffer_size = sprintf(buffer, block_header_text, b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
+      buffer_size = sprintf(buffer, block_header_text, b, BLOCK_VALID(b, s), BLOCK(b, s).dirty, lru_to_string(b, s), lfu_to_string(b, s), BLOCK_TAG(b, s));
       pango_layout_set_text(layout, buffer, buffer_size);
       gdk_draw_layout(widget->window, 
 		      widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -440,7 +438,7 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
 			  layout);
 	}
 
-	buffer_size = sprintf(buffer, "%02X", cache[b].block[s].data[o]);
+	buffer_size = sprintf(buffer, "%02X", BLOCK_DATA(b, s)[o]);
 	pango_layout_set_text(layout, buffer, buffer_size);
 	gdk_draw_layout(widget->window, 
 			widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -505,7 +503,7 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
 
       for(o = current->block_offset; o < current->block_offset + sizeof(instruction); o++)
       {
-	buffer_size = sprintf(buffer, "%02X", cache[current->block_index].block[current->unit_index].data[o]);
+	buffer_size = sprintf(buffer, "%02X", BLOCK_DATA(current->block_index, current->unit_index)[o]);
 	pango_layout_set_text(layout, buffer, buffer_size);
 	gdk_draw_layout_with_colors(widget->window, 
 				    widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -611,7 +609,7 @@ gboolean draw_cache_display_assoc (GtkWidget *widget, GdkEventExpose *event, gpo
 
     for(b = 0; b < set_count; b++)
     {      
-      buffer_size = sprintf(buffer, block_header_text, b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
+      buffer_size = sprintf(buffer, block_header_text, b, BLOCK_VALID(b, s), BLOCK(b, s).dirty, lru_to_string(b, s), lfu_to_string(b, s), BLOCK_TAG(b, s));
       pango_layout_set_text(layout, buffer, buffer_size);
       gdk_draw_layout(widget->window, 
 		      widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -634,7 +632,7 @@ gboolean draw_cache_display_assoc (GtkWidget *widget, GdkEventExpose *event, gpo
 			  layout);
 	}
 
-	buffer_size = sprintf(buffer, "%02X", cache[b].block[s].data[o]);
+	buffer_size = sprintf(buffer, "%02X", BLOCK_DATA(b, s)[o]);
 	pango_layout_set_text(layout, buffer, buffer_size);
 	gdk_draw_layout(widget->window, 
 			widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -703,7 +701,7 @@ gboolean draw_cache_display_assoc (GtkWidget *widget, GdkEventExpose *event, gpo
 
       for(o = current->block_offset; o < current->block_offset + sizeof(instruction); o++)
       {
-	buffer_size = sprintf(buffer, "%02X", cache[current->block_index].block[current->unit_index].data[o]);
+	buffer_size = sprintf(buffer, "%02X", BLOCK_DATA(current->block_index, current->unit_index)[o]);
 	pango_layout_set_text(layout, buffer, buffer_size);
 	gdk_draw_layout_with_colors(widget->window, 
 				    widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -800,70 +798,38 @@ GtkWidget* build_drawing_panel()
    Replacement policy related functions
 *****************************************************************************/
 
-gboolean random_listener(GtkWidget* widget, gpointer data)
+gboolean policy_listener(GtkWidget* widget, gpointer data)
 {
   if(GTK_TOGGLE_BUTTON(widget)->active)
-    panel_replacement_policy = RANDOM;
+    panel_replacement_policy = GPOINTER_TO_INT(data);
 
   return TRUE;
 }
 
-gboolean lru_listener(GtkWidget* widget, gpointer data)
-{
-  if(GTK_TOGGLE_BUTTON(widget)->active)
-    panel_replacement_policy = LRU;
-
-  return TRUE;
-}
-
-gboolean lfu_listener(GtkWidget* widget, gpointer data)
-{
-  if(GTK_TOGGLE_BUTTON(widget)->active)
-    panel_replacement_policy = LFU;
-
-  return TRUE;
-} 
-
 GtkWidget* build_replace_policy_panel(void)
 {
   GtkWidget* frame;
   GtkWidget* box;
+  GSList* group = NULL;
+  int p;
 
   box = gtk_vbox_new(FALSE, 0);
 
-  /* Build Random Policy radio button */
-  random_policy_button = gtk_radio_button_new_with_label(NULL, "Random");
-  g_signal_connect(G_OBJECT(random_policy_button), "clicked", G_CALLBACK(random_listener), NULL);
-
-  /* Build LRU Policy radio button */
-  lru_policy_button = gtk_radio_button_new_with_label(gtk_radio_button_get_group(GTK_RADIO_BUTTON(random_policy_button)), "LRU");
-  g_signal_connect(G_OBJECT(lru_policy_button), "clicked", G_CALLBACK(lru_listener), NULL);
-
-  /* Build LFU Policy radio button */
-  lfu_policy_button = gtk_radio_button_new_with_label(gtk_radio_button_get_group(GTK_RADIO_BUTTON(random_policy_button)), "LFU");
-  g_signal_connect(G_OBJECT(lfu_policy_button), "clicked", G_CALLBACK(lfu_listener), NULL);
-
-  /* Pack the radio buttons */
-  gtk_box_pack_start(GTK_BOX(box), lfu_policy_button, TRUE, TRUE, 0);
-  gtk_box_pack_start(GTK_BOX(box), lru_policy_button, TRUE, TRUE, 0);
-  gtk_box_pack_start(GTK_BOX(box), random_policy_button, TRUE, TRUE, 0);
-
-  /* Initialize radio buttons */
-  switch(panel_replacement_policy = policy)
+  /* Build a radio button for each policy, but OPT, which only traces can use */
+  for(p = 0; p < NUM_POLICIES; p++)
   {
-  case(RANDOM):
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(random_policy_button), TRUE);
-    break;
-  case(LRU):
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(lru_policy_button), TRUE);
-    break;
-  case(LFU):
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(lfu_policy_button), TRUE);
-    break;
-  default:
-    printf("Impossible situation with policy: %u", policy);
+    if(p == OPT)
+      continue;
+    policy_button[p] = gtk_radio_button_new_with_label(group, policy_name(p));
+    group = gtk_radio_button_get_group(GTK_RADIO_BUTTON(policy_button[p]));
+    g_signal_connect(G_OBJECT(policy_button[p]), "clicked", G_CALLBACK(policy_listener), GINT_TO_POINTER(p));
+    gtk_box_pack_start(GTK_BOX(box), policy_button[p], TRUE, TRUE, 0);
   }
 
+  /* Initialize radio buttons */
+  panel_replacement_policy = policy;
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(policy_button[policy]), TRUE);
+
   /* Pack radio buttons */
   frame = gtk_frame_new("Replacement Policy");
   gtk_container_add(GTK_CONTAINER(frame), box);
@@ -1180,17 +1146,19 @@ gboolean configure_button_listener(GtkWidget *widget, GdkEventExpose *event, gpo
   switch(result)
   {
   case GTK_RESPONSE_ACCEPT:
-    validate_cache_parameters(atoi(gtk_entry_get_text(GTK_ENTRY(index_entry))),
-			      atoi(gtk_entry_get_text(GTK_ENTRY(assoc_entry))),
-			      atoi(gtk_entry_get_text(GTK_ENTRY(block_entry))));
-    assert(panel_replacement_policy == RANDOM || panel_replacement_policy == LRU || panel_replacement_policy == LFU);
+    /* Keep the old cache and its policies if there is no room for the new one */
+    if(validate_cache_parameters(atoi(gtk_entry_get_text(GTK_ENTRY(index_entry))),
+				 atoi(gtk_entry_get_text(GTK_ENTRY(assoc_entry))),
+				 atoi(gtk_entry_get_text(GTK_ENTRY(block_entry)))) != 0)
+      break;
+    assert(panel_replacement_policy >= 0 && panel_replacement_policy < NUM_POLICIES);
     policy = panel_replacement_policy;
     assert(panel_memory_sync_policy == WRITE_BACK || panel_memory_sync_policy == WRITE_THROUGH);
     memory_sync_policy = panel_memory_sync_policy;
     assert(panel_cache_view == INDEX || panel_cache_view == ASSOC);
     view = panel_cache_view;
 
-    sprintf(buffer, "Cache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", set_count, assoc, block_size, (policy == RANDOM ? "Random" : (policy == LRU ? "LRU" : "LFU")), (memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
+    sprintf(buffer, "Cache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", set_count, assoc, block_size, policy_name(policy), (memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
     append_log(buffer);
     configure_cache_drawing_parameters(cache_canvas);
     flush_cache();
@@ -1,12 +1,24 @@
 #include "tips.h"
 
 /* Define Cache Parameters */
-cacheSet cache[MAX_SETS];
+unsigned int* cache_tag;
+unsigned int* cache_valid;
+cacheBlock* cache_block;
+cacheSet* cache_set;
+lfuBucket* cache_bucket;
+unsigned char* cache_heap;
+byte* cache_data;
 unsigned int block_size;
 unsigned int set_count;
 unsigned int assoc;
 ReplacementPolicy policy;
 MemorySyncPolicy memory_sync_policy;
+unsigned int lfu_aging;
+unsigned int offset_bits;
+unsigned int tag_shift;
+unsigned int index_mask;
+unsigned int offset_mask;
+cacheStats cache_stats;
 
 
 void init_memory() 
@@ -19,20 +31,122 @@ void flush_cache()
   int set_index;
   int block_index;
 
+  memset(&cache_stats, 0, sizeof(cache_stats));
+  cache_stats.psel = PSEL_MAX / 2;
+
+  /* nothing to flush until there is a cache */
+  if(cache_valid == NULL)
+    return;
+
   /* for each set */
   for( set_index=0; set_index < set_count; set_index++ )
   {
+    cache_valid[set_index] = 0;
+
     /* for each block in the set */
     for( block_index=0; block_index < assoc; block_index++ ) 
     {
-      cache[set_index].block[block_index].valid = INVALID;
-      cache[set_index].block[block_index].dirty = VIRGIN;
+      BLOCK(set_index, block_index).dirty = VIRGIN;
       init_lru(set_index, block_index);
       init_lfu(set_index, block_index);
     }
   }
 }
 
+/*
+  Write every dirty block of the cache back to memory. The blocks stay
+  in the cache, clean.
+ */
+void write_back_cache()
+{
+  unsigned int set_index;
+  unsigned int block_index;
+  address addr;
+
+  for(set_index = 0; set_index < set_count; set_index++)
+  {
+    for(block_index = 0; block_index < assoc; block_index++)
+    {
+      if(BLOCK_VALID(set_index, block_index) && BLOCK(set_index, block_index).dirty == DIRTY)
+      {
+        addr = (BLOCK_TAG(set_index, block_index) << tag_shift) | (set_index << offset_bits);
+        accessDRAMBlock(addr, BLOCK_DATA(set_index, block_index), block_size, WRITE);
+        BLOCK(set_index, block_index).dirty = VIRGIN;
+      }
+    }
+  }
+}
+
+/*
+  Replace the cache with an empty one of new_set_count sets of new_assoc
+  blocks of new_block_size bytes, after writing any dirty blocks back to
+  memory. If there isn't memory for it, the old cache is kept.
+
+  returns 0 if successful, non-zero if the cache couldn't be allocated.
+ */
+int allocate_cache(unsigned int new_set_count, unsigned int new_assoc, unsigned int new_block_size)
+{
+  size_t blocks = new_block_size != 0 ? (size_t)new_set_count * new_assoc : 0;
+  unsigned int* new_tag = NULL;
+  unsigned int* new_valid = NULL;
+  cacheBlock* new_block = NULL;
+  cacheSet* new_set = NULL;
+  lfuBucket* new_bucket = NULL;
+  unsigned char* new_heap = NULL;
+  byte* new_data = NULL;
+
+  if(blocks != 0)
+  {
+    new_tag = (unsigned int*)calloc(blocks + TAG_PADDING, sizeof(unsigned int));
+    new_valid = (unsigned int*)calloc(new_set_count, sizeof(unsigned int));
+    new_block = (cacheBlock*)calloc(blocks, sizeof(cacheBlock));
+    new_set = (cacheSet*)calloc(new_set_count, sizeof(cacheSet));
+    new_bucket = (lfuBucket*)calloc(blocks, sizeof(lfuBucket));
+    new_heap = (unsigned char*)calloc(blocks, sizeof(unsigned char));
+    new_data = (byte*)calloc(blocks, new_block_size);
+    if(new_tag == NULL || new_valid == NULL || new_block == NULL || new_set == NULL || new_bucket == NULL || new_heap == NULL || new_data == NULL)
+    {
+      free(new_tag);
+      free(new_valid);
+      free(new_block);
+      free(new_set);
+      free(new_bucket);
+      free(new_heap);
+      free(new_data);
+      return -1;
+    }
+  }
+
+  /* Write back what the old cache holds */
+  write_back_cache();
+
+  free(cache_tag);
+  free(cache_valid);
+  free(cache_block);
+  free(cache_set);
+  free(cache_bucket);
+  free(cache_heap);
+  free(cache_data);
+  cache_tag = new_tag;
+  cache_valid = new_valid;
+  cache_block = new_block;
+  cache_set = new_set;
+  cache_bucket = new_bucket;
+  cache_heap = new_heap;
+  cache_data = new_data;
+  set_count = new_set_count;
+  assoc = new_assoc;
+  block_size = new_block_size;
+
+  /* Both are powers of two, so the logs are the trailing zeros */
+  offset_bits = block_size != 0 ? __builtin_ctz(block_size) : 0;
+  tag_shift = offset_bits + (set_count != 0 ? __builtin_ctz(set_count) : 0);
+  index_mask = set_count - 1;
+  offset_mask = block_size - 1;
+  flush_cache();
+  return 0;
+}
+
 static int translateAddress(address virtual_addr, address* physical_addr)
 {
   static struct PageTableEntry {
@@ -140,3 +254,28 @@ int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag)
 
   return error;
 }
+
+/*
+  Move size bytes, a power of two, to or from memory in as few transfers
+  as accessDRAM() allows.
+
+  returns 0 if successful, non-zero if there was a problem.
+ */
+int accessDRAMBlock(address addr, byte* data, unsigned int size, WriteEnable flag)
+{
+  TransferUnit mode = OCTWORD_SIZE;
+  unsigned int chunk = 32;
+  unsigned int i;
+  int error = 0;
+
+  while(chunk > size)
+  {
+    chunk >>= 1;
+    mode--;
+  }
+
+  for(i = 0; i < size; i += chunk)
+    error |= accessDRAM(addr + i, data + i, mode, flag);
+
+  return error;
+}
@@ -108,10 +108,10 @@ void display_cache()
     {
       for(s = 0; s < assoc; s++)
       {
-	printf("%2d  %d %d  %s\t%s\t%08x    ", b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
+	printf("%2d  %d %d  %s\t%s\t%08x    ", b, BLOCK_VALID(b, s), BLOCK(b, s).dirty, lru_to_string(b, s), lfu_to_string(b, s), BLOCK_TAG(b, s));
 	for(o = 0; o < block_size; o++)
 	{
-	  printf("%02x", cache[b].block[s].data[o]);
+	  printf("%02x", BLOCK_DATA(b, s)[o]);
 
 	  if((o + 1) != block_size)
 	  {
@@ -133,10 +133,10 @@ void display_cache()
 
       for(b = 0; b < set_count; b++)
       {
-	printf("%2d  %d %d  %s\t%s\t%08x    ", b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
+	printf("%2d  %d %d  %s\t%s\t%08x    ", b, BLOCK_VALID(b, s), BLOCK(b, s).dirty, lru_to_string(b, s), lfu_to_string(b, s), BLOCK_TAG(b, s));
 	for(o = 0; o < block_size; o++)
 	{
-	  printf("%02x", cache[b].block[s].data[o]);
+	  printf("%02x", BLOCK_DATA(b, s)[o]);
 
 	  if((o + 1) != block_size)
 	  {
@@ -174,12 +174,40 @@ void display_help()
   printf("config <set_count> <assoc> <block_size> <Replacement Policy> <Sync Policy> --\n");
   printf("  Set cache to have <set_count> sets (i.e. number of unique indexes), <assoc>\n");
   printf("  blocks per setm with each block to have size <block_size>. <Replacment\n");
-  printf("  Policy> is either 'lru' for LRU, 'r' for RANDOM, or 'lfu' for LFU.\n");
+  printf("  Policy> is 'lru' for LRU, 'r' for RANDOM, 'lfu' for LFU, 'plru' for\n");
+  printf("  tree pseudo-LRU, 'bplru' for bit pseudo-LRU, 'srrip' or 'brrip' for\n");
+  printf("  static or bimodal RRIP, 'drrip' for dynamic RRIP (SRRIP and BRRIP\n");
+  printf("  dueling), 'dip' for dynamic insertion (LRU and BIP dueling) or 'opt'\n");
+  printf("  for Belady's optimal replacement, which only the trace command can use.\n");
   printf("  <Sync Policy> is either 'wb' for WRITE_BACK or 'wt' for WRITE_THROUGH\n");
   printf("\n");
+  printf("aging <n> -- Halve the LFU access counts of a set after every <n>\n");
+  printf("  accesses to it, or never if <n> is 0\n");
+  printf("\n");
   printf("view <mode> -- change how cache is drawn. <mode> is either 'index' for\n");
   printf("  index-based view of cache or 'assoc' for associativity-based view\n");
   printf("\n");
+  printf("trace <file> -- Replay the accesses of <file> through an empty cache and\n");
+  printf("  print the stats. <file> is a trace in Dinero's din format, or binary:\n");
+  printf("  \"TIPSTRC1\" then a little-endian word for each access, its address with\n");
+  printf("  the din label (0 read, 1 write, 2 fetch) in place of the low two bits\n");
+  printf("\n");
+  printf("mrc <file> <block_size> [max_sets] -- In one pass over the trace <file>,\n");
+  printf("  work out the LRU miss rates with <block_size> byte blocks: fully\n");
+  printf("  associative at every size, and with each power of two of sets up to\n");
+  printf("  [max_sets] (1024 if not given) at each associativity\n");
+  printf("\n");
+  printf("reuse <file> [block_size [region_size]] -- Print histograms of the reuse\n");
+  printf("  distances of the reads and writes of the trace <file>, in distinct\n");
+  printf("  blocks of [block_size] bytes (the cache's, or 4), for all of them and\n");
+  printf("  by [region_size] byte regions of memory (4096 if not given); like\n");
+  printf("  \"reuse on\", it leaves out instruction fetches\n");
+  printf("\n");
+  printf("reuse on [block_size [region_size]] -- Record the reuse distances of the\n");
+  printf("  program's loads and stores from now on, also by load or store PC\n");
+  printf("\n");
+  printf("reuse off -- Stop recording reuse distances\n");
+  printf("\n");
   printf("step N -- Step the program for N instructions\n");
   printf("\n");
   printf("run <time>-- Start automated simulation with instructions executing\n");
@@ -189,6 +217,11 @@ void display_help()
   printf("\n");
   printf("print cache -- Print the current cache state\n");
   printf("\n");
+  printf("print stats -- Print the miss rate since the cache was last flushed,\n");
+  printf("  and for 'drrip' and 'dip' each dueling policy's and which is winning\n");
+  printf("\n");
+  printf("print reuse -- Print the reuse distances recorded since \"reuse on\"\n");
+  printf("\n");
   printf("reset cpu -- Reset the PC and $sp back to startup values\n");
   printf("\n");
   printf("reset cache -- Flush the cache\n");
@@ -241,13 +274,7 @@ void configure_cache(StringTokenizer* tokenizer)
   command = nextToken(tokenizer);
   if(strlen(command) != 0)
   {
-    if(strcmp(command, "lru") == 0)
-      p = LRU;
-    else if(strcmp(command, "r") == 0)
-      p = RANDOM;
-    else if(strcmp(command, "lfu") == 0)
-      p = LFU;
-    else
+    if(parse_policy(command, &p) != 0)
     {
       printf("Invalid parameter for Replacement Policy\n");
       return;
@@ -279,12 +306,13 @@ void configure_cache(StringTokenizer* tokenizer)
     return;
   }
 
-  validate_cache_parameters(index, assoc, block);      
+  /* Keep the old cache and its policies if there is no room for the new one */
+  if(validate_cache_parameters(index, assoc, block) != 0)
+    return;
   policy = p;
   memory_sync_policy = m;
 
-  //I'm probably making this way too ugly with the additional check for LFU
-  printf("\nCache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", set_count, assoc, block_size, (policy == RANDOM ? "Random" : (policy == LRU ? "LRU" : "LFU")), (memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
+  printf("\nCache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", set_count, assoc, block_size, policy_name(policy), (memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
 }
 
 void do_step(StringTokenizer* tokenizer)
@@ -300,6 +328,12 @@ void do_step(StringTokenizer* tokenizer)
   if(n <= 0)
     n = 1;
 
+  if(policy == OPT)
+  {
+    printf("OPT needs to know the future, so only traces can use it\n");
+    return;
+  }
+
   for(i = 0; i < n; i++)
     step_processor();
 }
@@ -329,8 +363,11 @@ void activate_no_gui(int argc, char** argv)
   int console_active = 1;
   StringTokenizer* tokenizer;
   char input[200];
+  char filename[200];
   char* command;
   int speed;
+  int block;
+  int region;
 
   (void)signal(SIGINT, catch);
   run_active = 0;
@@ -361,11 +398,29 @@ void activate_no_gui(int argc, char** argv)
 	display_regs();
       else if(strcmp(command, "cache") == 0)
 	display_cache();
+      else if(strcmp(command, "stats") == 0)
+	print_stats();
+      else if(strcmp(command, "reuse") == 0)
+	print_reuse();
       else
 	printf("Invalid command: %s\n", input);
     }
     else if(strcmp(command, "config") == 0)
       configure_cache(tokenizer);
+    else if(strcmp(command, "aging") == 0)
+    {
+      command = nextToken(tokenizer);
+      if(strlen(command) == 0 || atoi(command) < 0)
+	printf("Invalid command: %s\n", input);
+      else
+      {
+	lfu_aging = atoi(command);
+	if(lfu_aging == 0)
+	  printf("LFU counts are never halved\n");
+	else
+	  printf("LFU counts are halved every %u accesses to a set\n", lfu_aging);
+      }
+    }
     else if(strcmp(command, "view") == 0)
     {
       command = nextToken(tokenizer);
@@ -391,6 +446,43 @@ void activate_no_gui(int argc, char** argv)
       do_step(tokenizer);
     else if(strcmp(command, "step") == 0)
       do_step(tokenizer);
+    else if(strcmp(command, "trace") == 0)
+    {
+      command = nextToken(tokenizer);
+      run_trace(command);
+    }
+    else if(strcmp(command, "mrc") == 0)
+    {
+      command = nextToken(tokenizer);
+      strcpy(filename, command);
+      command = nextToken(tokenizer);
+      block = atoi(command);
+      command = nextToken(tokenizer);
+      run_mrc(filename, block, strlen(command) != 0 ? atoi(command) : 1024);
+    }
+    else if(strcmp(command, "reuse") == 0)
+    {
+      command = nextToken(tokenizer);
+      strcpy(filename, command);
+      if(strcmp(filename, "off") == 0)
+      {
+	reuse_active = 0;
+	printf("Reuse distances no longer recorded\n");
+      }
+      else
+      {
+	command = nextToken(tokenizer);
+	block = strlen(command) != 0 ? atoi(command) : block_size != 0 ? (int)block_size : 4;
+	command = nextToken(tokenizer);
+	region = strlen(command) != 0 ? atoi(command) : 4096;
+	if(strcmp(filename, "on") != 0)
+	  run_reuse(filename, block, region);
+	else if(start_reuse(block, region) == 0)
+	  printf("Reuse distances recorded from now on\n");
+      }
+    }
+    else if(strcmp(command, "run") == 0 && policy == OPT)
+      printf("OPT needs to know the future, so only traces can use it\n");
     else if(strcmp(command, "run") == 0)
     {
       command = nextToken(tokenizer);
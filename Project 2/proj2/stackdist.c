@@ -0,0 +1,759 @@
+#include "tips.h"
+#include "util.h"
+
+/*
+  Stack distance
+  ==============
+  The stack distance of an access is the number of distinct blocks used
+  since the last access to the same block, that block included. An LRU
+  set of n blocks hits exactly the accesses at distance n or less, so one
+  pass over a trace, counting the accesses at each distance, gives the
+  misses of every associativity at once (Mattson et al, 1970).
+
+  For a cache of a given number of sets, each set has a clock that
+  ticks at each access to it, and marks the tick of the latest use of
+  each of its blocks in a Fenwick tree, so the distance of an access is
+  one more than the number of marks after the block's last tick, found
+  in O(log n) steps. When the clock runs out of room the marks are
+  packed down to the first ticks, so a set needs room for about twice
+  as many ticks as it has blocks, however long the trace.
+
+  The reuse distance of an access, the number of other distinct blocks
+  used since the last access to the same block, is one less than its
+  stack distance in a fully associative cache.
+*/
+
+/* Marks an empty hash slot, and a tick that is no block's latest use */
+#define NO_LINE 0xffffffffu
+
+/* The fewest ticks a set has room for */
+#define MIN_TICKS 16
+
+typedef struct {
+  int* tree;              /* Fenwick tree of the marks */
+  unsigned int* line;     /* the block marked at each tick, or NO_LINE */
+  unsigned int size;      /* ticks there is room for, a power of two */
+  unsigned int now;       /* the next tick */
+  unsigned int lines;     /* blocks marked */
+} stackSet;
+
+/* The sets of one cache, and how many accesses were at each distance in it */
+typedef struct {
+  stackSet* sets;
+  unsigned long long* histogram;   /* [0] counts first uses */
+  unsigned int histogram_size;
+} stackLayout;
+
+/*
+  A stackEngine follows caches of 1, 2, 4 ... sets at once, layout k
+  having 2^k sets, so that one hash table lookup finds the last tick of
+  a block in all of them
+*/
+typedef struct {
+  unsigned int layouts;
+  stackLayout* layout;
+  unsigned int* keys;     /* hash table from each block seen ... */
+  unsigned int* ticks;    /* ... to the tick of its latest use in each layout */
+  unsigned int slots;     /* a power of two */
+  unsigned int used;
+} stackEngine;
+
+/* adds delta to the count at tick i of a Fenwick tree */
+static void fenwick_add(int* tree, unsigned int size, unsigned int i, int delta)
+{
+  for(i++; i <= size; i += i & -i)
+    tree[i - 1] += delta;
+}
+
+/* returns the sum of the counts of ticks 0 to i - 1 of a Fenwick tree */
+static int fenwick_sum(const int* tree, unsigned int i)
+{
+  int sum = 0;
+
+  for(; i > 0; i -= i & -i)
+    sum += tree[i - 1];
+  return sum;
+}
+
+/* returns the hash slot of block line, or the empty slot it would go in */
+static unsigned int find_slot(const stackEngine* engine, unsigned int line)
+{
+  unsigned int slot = (line * 0x9e3779b1u) & (engine->slots - 1);
+
+  while(engine->keys[slot] != NO_LINE && engine->keys[slot] != line)
+    slot = (slot + 1) & (engine->slots - 1);
+  return slot;
+}
+
+/*
+  This function doubles the size of an engine's hash table
+
+  returns 0 if successful, non-zero if there isn't memory for it
+ */
+static int grow_table(stackEngine* engine)
+{
+  unsigned int* old_keys = engine->keys;
+  unsigned int* old_ticks = engine->ticks;
+  unsigned int old_slots = engine->slots;
+  unsigned int slot;
+  unsigned int i;
+
+  engine->slots = old_slots != 0 ? 2 * old_slots : 1024;
+  engine->keys = (unsigned int*)malloc(engine->slots * sizeof(unsigned int));
+  engine->ticks = (unsigned int*)malloc((size_t)engine->slots * engine->layouts * sizeof(unsigned int));
+  if(engine->keys == NULL || engine->ticks == NULL)
+  {
+    free(engine->keys);
+    free(engine->ticks);
+    engine->keys = old_keys;
+    engine->ticks = old_ticks;
+    engine->slots = old_slots;
+    return -1;
+  }
+
+  memset(engine->keys, 0xff, engine->slots * sizeof(unsigned int));
+  for(i = 0; i < old_slots; i++)
+  {
+    if(old_keys[i] != NO_LINE)
+    {
+      slot = find_slot(engine, old_keys[i]);
+      engine->keys[slot] = old_keys[i];
+      memcpy(engine->ticks + (size_t)slot * engine->layouts, old_ticks + (size_t)i * engine->layouts, engine->layouts * sizeof(unsigned int));
+    }
+  }
+  free(old_keys);
+  free(old_ticks);
+  return 0;
+}
+
+/*
+  This function packs the marks of a set down to its first ticks, with
+  room for as many ticks again
+
+    engine - the engine the set belongs to
+    k - the set's layout
+    set - the set, whose clock has run out of room
+
+  returns 0 if successful, non-zero if there isn't memory for it
+ */
+static int pack_set(stackEngine* engine, unsigned int k, stackSet* set)
+{
+  unsigned int size = MIN_TICKS;
+  unsigned int* line;
+  int* tree;
+  unsigned int tick;
+  unsigned int next;
+  unsigned int i;
+
+  while(size < 2 * set->lines)
+    size *= 2;
+  tree = (int*)malloc(size * sizeof(int));
+  line = (unsigned int*)malloc(size * sizeof(unsigned int));
+  if(tree == NULL || line == NULL)
+  {
+    free(tree);
+    free(line);
+    return -1;
+  }
+
+  //the marks keep their order, so the distances don't change
+  next = 0;
+  for(tick = 0; tick < set->now; tick++)
+  {
+    if(set->line[tick] != NO_LINE)
+    {
+      line[next] = set->line[tick];
+      engine->ticks[(size_t)find_slot(engine, line[next]) * engine->layouts + k] = next;
+      next++;
+    }
+  }
+
+  //build the tree over the marks in one pass
+  for(i = 0; i < size; i++)
+    tree[i] = i < next;
+  for(i = 1; i <= size; i++)
+  {
+    if(i + (i & -i) <= size)
+      tree[i + (i & -i) - 1] += tree[i - 1];
+  }
+
+  free(set->tree);
+  free(set->line);
+  set->tree = tree;
+  set->line = line;
+  set->size = size;
+  set->now = next;
+  return 0;
+}
+
+/*
+  This function sets up an engine for caches of 1, 2, 4 ... sets
+
+    engine - the engine
+    layouts - how many caches, the last of 2^(layouts - 1) sets
+
+  returns 0 if successful, non-zero if there isn't memory for it
+ */
+static int init_engine(stackEngine* engine, unsigned int layouts)
+{
+  unsigned int k;
+
+  memset(engine, 0, sizeof(stackEngine));
+  engine->layout = (stackLayout*)calloc(layouts, sizeof(stackLayout));
+  if(engine->layout == NULL)
+    return -1;
+  engine->layouts = layouts;
+  for(k = 0; k < layouts; k++)
+  {
+    engine->layout[k].sets = (stackSet*)calloc((size_t)1 << k, sizeof(stackSet));
+    engine->layout[k].histogram_size = 64;
+    engine->layout[k].histogram = (unsigned long long*)calloc(64, sizeof(unsigned long long));
+    if(engine->layout[k].sets == NULL || engine->layout[k].histogram == NULL)
+      return -1;
+  }
+  return grow_table(engine);
+}
+
+static void free_engine(stackEngine* engine)
+{
+  unsigned int k;
+  unsigned int i;
+
+  for(k = 0; k < engine->layouts; k++)
+  {
+    for(i = 0; engine->layout[k].sets != NULL && i < (1u << k); i++)
+    {
+      free(engine->layout[k].sets[i].tree);
+      free(engine->layout[k].sets[i].line);
+    }
+    free(engine->layout[k].sets);
+    free(engine->layout[k].histogram);
+  }
+  free(engine->layout);
+  free(engine->keys);
+  free(engine->ticks);
+}
+
+/*
+  This function finds the stack distance of an access in each layout and
+  counts it
+
+    engine - the engine
+    line - the block accessed, its address without the offset bits
+    distance - set to the stack distance in each layout, or 0 for the
+               block's first use
+
+  returns 0 if successful, non-zero if there isn't memory to go on
+ */
+static int engine_access(stackEngine* engine, unsigned int line, unsigned int* distance)
+{
+  stackLayout* layout;
+  stackSet* set;
+  unsigned long long* bigger;
+  unsigned int* ticks;
+  unsigned int slot;
+  unsigned int last;
+  unsigned int k;
+  int seen;
+
+  if(2 * (engine->used + 1) > engine->slots && grow_table(engine) != 0)
+    return -1;
+  slot = find_slot(engine, line);
+  seen = engine->keys[slot] == line;
+  if(!seen)
+  {
+    engine->keys[slot] = line;
+    engine->used++;
+  }
+
+  for(k = 0; k < engine->layouts; k++)
+  {
+    layout = &engine->layout[k];
+    set = &layout->sets[line & ((1u << k) - 1)];
+    if(set->now == set->size && pack_set(engine, k, set) != 0)
+      return -1;
+
+    ticks = &engine->ticks[(size_t)slot * engine->layouts + k];
+    if(seen)
+    {
+      //one more than the blocks marked since, and take the old mark away
+      last = *ticks;
+      distance[k] = fenwick_sum(set->tree, set->now) - fenwick_sum(set->tree, last + 1) + 1;
+      fenwick_add(set->tree, set->size, last, -1);
+      set->line[last] = NO_LINE;
+    }
+    else
+    {
+      distance[k] = 0;
+      set->lines++;
+    }
+    fenwick_add(set->tree, set->size, set->now, 1);
+    set->line[set->now] = line;
+    *ticks = set->now++;
+
+    while(distance[k] >= layout->histogram_size)
+    {
+      bigger = (unsigned long long*)realloc(layout->histogram, 2 * layout->histogram_size * sizeof(unsigned long long));
+      if(bigger == NULL)
+        return -1;
+      memset(bigger + layout->histogram_size, 0, layout->histogram_size * sizeof(unsigned long long));
+      layout->histogram = bigger;
+      layout->histogram_size *= 2;
+    }
+    layout->histogram[distance[k]]++;
+  }
+  return 0;
+}
+
+/*
+  This function works out, from a layout's histogram, the misses of an
+  LRU cache with each associativity: those at a greater distance than
+  the associativity, and the first uses
+
+    layout - the layout
+    misses - set to the misses with associativity a at [a], for a from 1
+             up to the layout's largest distance; at larger ones only
+             the first uses miss, as at the largest
+
+  returns the largest distance
+ */
+static unsigned int layout_misses(const stackLayout* layout, unsigned long long* misses)
+{
+  unsigned int largest = 0;
+  unsigned int d;
+
+  for(d = 1; d < layout->histogram_size; d++)
+  {
+    if(layout->histogram[d] != 0)
+      largest = d;
+  }
+  misses[largest] = layout->histogram[0];
+  for(d = largest; d-- > 0; )
+    misses[d] = misses[d + 1] + layout->histogram[d + 1];
+  return largest;
+}
+
+/* returns misses as a percentage of accesses */
+static double miss_rate(unsigned long long misses, unsigned long long accesses)
+{
+  return accesses != 0 ? 100.0 * misses / accesses : 0.0;
+}
+
+/*
+  This function works out, in one pass over a trace, the misses of LRU
+  caches with blocks of block_size bytes: fully associative ones of
+  every size, and those of up to max_sets sets of every associativity
+  up to MAX_ASSOC
+
+    filename - the trace, in din or binary format
+    block_size_value - the block size
+    max_sets_value - the most sets
+
+  returns 0 if successful, non-zero if the trace couldn't be read
+ */
+int run_mrc(const char* filename, int block_size_value, int max_sets_value)
+{
+  char buffer[200];
+  char* column;
+  traceReader reader;
+  stackEngine engine;
+  unsigned long long* misses = NULL;
+  unsigned long long accesses = 0;
+  unsigned int block_bits;
+  unsigned int set_bits;
+  unsigned int access;
+  unsigned int distance[32];
+  unsigned int largest;
+  unsigned int size;
+  unsigned int a;
+  unsigned int k;
+  int error = 0;
+  int result = -1;
+
+  //powers of two, as config makes them
+  if(block_size_value < 4 || block_size_value > MAX_BLOCK_SIZE || max_sets_value < 1)
+  {
+    append_log("The block size must be 4 to 4096 bytes and there must be a set\n");
+    return -1;
+  }
+  block_bits = uint_log2(block_size_value);
+  set_bits = uint_log2(max_sets_value < MAX_SETS ? max_sets_value : MAX_SETS);
+
+  if(open_trace(&reader, filename) != 0)
+  {
+    sprintf(buffer, "Unable to load [%s]\n", filename);
+    append_log(buffer);
+    return -1;
+  }
+
+  error = init_engine(&engine, set_bits + 1);
+  while(error == 0 && next_access(&reader, &access))
+  {
+    error = engine_access(&engine, access >> block_bits, distance);
+    accesses++;
+  }
+  close_trace(&reader);
+
+  //the fully associative cache has the longest distances
+  if(error == 0)
+    misses = (unsigned long long*)malloc(engine.layout[0].histogram_size * sizeof(unsigned long long));
+  if(misses == NULL)
+  {
+    sprintf(buffer, "Not enough memory for [%s]\n", filename);
+    append_log(buffer);
+  }
+  else
+  {
+    result = 0;
+    sprintf(buffer, "[%s]: %llu accesses to %u distinct %u-byte blocks\n", filename, accesses, engine.used, 1u << block_bits);
+    append_log(buffer);
+
+    //every size of fully associative cache, shown at the powers of two
+    append_log("Fully associative LRU, by the blocks in the cache:\n  blocks          misses  miss rate\n");
+    largest = layout_misses(&engine.layout[0], misses);
+    for(size = 1; ; size *= 2)
+    {
+      sprintf(buffer, "%8u  %14llu  %8.2f%%\n", size, misses[size < largest ? size : largest], miss_rate(misses[size < largest ? size : largest], accesses));
+      append_log(buffer);
+      if(size >= largest)
+        break;
+    }
+
+    append_log("LRU miss rate, by sets (rows) and associativity (columns):\n    sets");
+    for(a = 1; a <= MAX_ASSOC; a *= 2)
+    {
+      sprintf(buffer, "  %7u", a);
+      append_log(buffer);
+    }
+    append_log("\n");
+    for(k = 0; k <= set_bits; k++)
+    {
+      largest = layout_misses(&engine.layout[k], misses);
+      column = buffer + sprintf(buffer, "%8u", 1u << k);
+      for(a = 1; a <= MAX_ASSOC; a *= 2)
+        column += sprintf(column, "  %6.2f%%", miss_rate(misses[a < largest ? a : largest], accesses));
+      sprintf(column, "\n");
+      append_log(buffer);
+    }
+  }
+
+  free_engine(&engine);
+  free(misses);
+  return result;
+}
+
+/*
+  Reuse distance histograms
+  =========================
+  While reuse_active is set, record_reuse() counts the reuse distance of
+  each access it is given in log2 buckets: first uses, 0, 1, 2-3, 4-7 and
+  so on. There is a histogram for all the accesses, one for each load or
+  store PC, and one for each region of the address space.
+
+  Only data accesses are counted, so a trace and a run of the program
+  give the same distances: the program records its loads and stores,
+  and the instruction fetches of a trace are skipped. Fetches would
+  only stretch the distances of the data they come between.
+*/
+#define REUSE_BUCKETS 34
+
+/* Marks an access with no PC, from a trace */
+#define NO_PC 0xffffffffu
+
+/* The most histograms printed of each kind, those with the most accesses */
+#define REUSE_TOP 20
+
+typedef struct {
+  unsigned int key;       /* the PC or the region's first address */
+  unsigned long long accesses;
+  unsigned long long bucket[REUSE_BUCKETS];
+} reuseHistogram;
+
+/* Histograms found by their key through a hash table of their indexes */
+typedef struct {
+  reuseHistogram* histogram;
+  unsigned int count;
+  unsigned int room;
+  unsigned int* index;    /* one more than a histogram's index, 0 if empty */
+  unsigned int slots;     /* a power of two */
+} reuseTable;
+
+int reuse_active;
+static stackEngine reuse_engine;
+static unsigned int reuse_block_bits;
+static unsigned int reuse_region_bits;
+static reuseHistogram reuse_all;
+static reuseTable reuse_by_pc;
+static reuseTable reuse_by_region;
+
+/* the slot to look for a key in first; regions' low bits are all 0, so it takes the high bits */
+static unsigned int hash_key(unsigned int key, unsigned int slots)
+{
+  return (key * 0x9e3779b1u) >> (32 - uint_log2(slots));
+}
+
+static void free_table(reuseTable* table)
+{
+  free(table->histogram);
+  free(table->index);
+  memset(table, 0, sizeof(reuseTable));
+}
+
+/*
+  This function finds the histogram with the given key, adding it if
+  there is none
+
+    table - the histograms
+    key - the PC or region
+
+  returns the histogram, or NULL if there isn't memory for it
+ */
+static reuseHistogram* find_histogram(reuseTable* table, unsigned int key)
+{
+  reuseHistogram* bigger;
+  unsigned int* old_index = table->index;
+  unsigned int old_slots = table->slots;
+  unsigned int slot;
+  unsigned int i;
+
+  //keep the hash table at most half full
+  if(2 * (table->count + 1) > table->slots)
+  {
+    table->slots = old_slots != 0 ? 2 * old_slots : 256;
+    table->index = (unsigned int*)calloc(table->slots, sizeof(unsigned int));
+    if(table->index == NULL)
+    {
+      table->index = old_index;
+      table->slots = old_slots;
+      return NULL;
+    }
+    for(i = 0; i < table->count; i++)
+    {
+      slot = hash_key(table->histogram[i].key, table->slots);
+      while(table->index[slot] != 0)
+        slot = (slot + 1) & (table->slots - 1);
+      table->index[slot] = i + 1;
+    }
+    free(old_index);
+  }
+
+  slot = hash_key(key, table->slots);
+  while(table->index[slot] != 0)
+  {
+    if(table->histogram[table->index[slot] - 1].key == key)
+      return &table->histogram[table->index[slot] - 1];
+    slot = (slot + 1) & (table->slots - 1);
+  }
+
+  if(table->count == table->room)
+  {
+    bigger = (reuseHistogram*)realloc(table->histogram, 2 * (table->room + 64) * sizeof(reuseHistogram));
+    if(bigger == NULL)
+      return NULL;
+    table->histogram = bigger;
+    table->room = 2 * (table->room + 64);
+  }
+  memset(&table->histogram[table->count], 0, sizeof(reuseHistogram));
+  table->histogram[table->count].key = key;
+  table->index[slot] = ++table->count;
+  return &table->histogram[table->count - 1];
+}
+
+/*
+  This function clears the reuse histograms and starts recording
+
+    block_size_value - the block size distances are counted in
+    region_size_value - the size of the address regions
+
+  returns 0 if successful, non-zero if the sizes aren't allowed or there
+  isn't memory
+ */
+int start_reuse(int block_size_value, int region_size_value)
+{
+  reuse_active = 0;
+  if(block_size_value < 4 || block_size_value > MAX_BLOCK_SIZE || region_size_value < block_size_value)
+  {
+    append_log("The block size must be 4 to 4096 bytes, and regions no smaller\n");
+    return -1;
+  }
+  reuse_block_bits = uint_log2(block_size_value);
+  reuse_region_bits = uint_log2(region_size_value);
+
+  free_engine(&reuse_engine);
+  free_table(&reuse_by_pc);
+  free_table(&reuse_by_region);
+  memset(&reuse_all, 0, sizeof(reuseHistogram));
+  if(init_engine(&reuse_engine, 1) != 0)
+  {
+    append_log("Not enough memory to record reuse distances\n");
+    return -1;
+  }
+  reuse_active = 1;
+  return 0;
+}
+
+/* counts an access in bucket b of histogram h */
+static void count_reuse(reuseHistogram* h, unsigned int b)
+{
+  h->accesses++;
+  h->bucket[b]++;
+}
+
+/*
+  This function counts the reuse distance of an access, stopping the
+  recording if there isn't memory to go on
+
+    addr - the address accessed
+    pc - the address of the load or store, or NO_PC
+ */
+void record_reuse(address addr, address pc)
+{
+  reuseHistogram* by_pc = NULL;
+  reuseHistogram* by_region;
+  unsigned int distance;
+  unsigned int b;
+
+  if(engine_access(&reuse_engine, addr >> reuse_block_bits, &distance) != 0 ||
+     (pc != NO_PC && (by_pc = find_histogram(&reuse_by_pc, pc)) == NULL) ||
+     (by_region = find_histogram(&reuse_by_region, addr >> reuse_region_bits << reuse_region_bits)) == NULL)
+  {
+    append_log("Not enough memory to record reuse distances; stopped\n");
+    reuse_active = 0;
+    return;
+  }
+
+  //bucket 1 is distance 0, and bucket k + 2 holds 2^k up to 2^(k + 1) - 1
+  if(distance == 0)
+    b = 0;
+  else if(distance == 1)
+    b = 1;
+  else
+    b = 33 - __builtin_clz(distance - 1);
+
+  count_reuse(&reuse_all, b);
+  if(by_pc != NULL)
+    count_reuse(by_pc, b);
+  count_reuse(by_region, b);
+}
+
+/* orders histograms by accesses, most first */
+static int by_accesses(const void* a, const void* b)
+{
+  const reuseHistogram* x = *(const reuseHistogram* const*)a;
+  const reuseHistogram* y = *(const reuseHistogram* const*)b;
+
+  return x->accesses < y->accesses ? 1 : x->accesses > y->accesses ? -1 : 0;
+}
+
+/* prints a histogram's line: its accesses, and the count in each bucket used */
+static void print_histogram(const char* what, const reuseHistogram* h)
+{
+  char buffer[2000];
+  char* end = buffer;
+  const char* separator = " ";
+  unsigned int b;
+
+  end += sprintf(end, "  %-12s %12llu accesses:", what, h->accesses);
+  for(b = 0; b < REUSE_BUCKETS; b++)
+  {
+    if(h->bucket[b] == 0)
+      continue;
+    if(b == 0)
+      end += sprintf(end, "%sfirst %llu", separator, h->bucket[b]);
+    else if(b <= 3)
+      end += sprintf(end, "%s%s %llu", separator, b == 1 ? "0" : b == 2 ? "1" : "2-3", h->bucket[b]);
+    else
+      end += sprintf(end, "%s%u-%u %llu", separator, 1u << (b - 2), (1u << (b - 2)) + ((1u << (b - 2)) - 1), h->bucket[b]);
+    separator = ", ";
+  }
+  sprintf(end, "\n");
+  append_log(buffer);
+}
+
+/* prints the REUSE_TOP histograms of a table with the most accesses */
+static void print_table(const reuseTable* table)
+{
+  const reuseHistogram** order;
+  char what[20];
+  unsigned int i;
+
+  order = (const reuseHistogram**)malloc((table->count + 1) * sizeof(reuseHistogram*));
+  if(order == NULL)
+    return;
+  for(i = 0; i < table->count; i++)
+    order[i] = &table->histogram[i];
+  qsort(order, table->count, sizeof(reuseHistogram*), by_accesses);
+  for(i = 0; i < table->count && i < REUSE_TOP; i++)
+  {
+    sprintf(what, "0x%08x", order[i]->key);
+    print_histogram(what, order[i]);
+  }
+  free(order);
+}
+
+/*
+  This function prints the reuse histograms recorded since start_reuse():
+  for all accesses, for the load and store PCs, and for the regions
+ */
+void print_reuse(void)
+{
+  char buffer[200];
+
+  sprintf(buffer, "Reuse distance, in distinct %u-byte blocks:\n", 1u << reuse_block_bits);
+  append_log(buffer);
+  print_histogram("all", &reuse_all);
+  if(reuse_by_pc.count != 0)
+  {
+    sprintf(buffer, "By load or store PC, the %u of %u with the most accesses:\n", reuse_by_pc.count < REUSE_TOP ? reuse_by_pc.count : REUSE_TOP, reuse_by_pc.count);
+    append_log(buffer);
+    print_table(&reuse_by_pc);
+  }
+  sprintf(buffer, "By %u-byte region, the %u of %u with the most accesses:\n", 1u << reuse_region_bits, reuse_by_region.count < REUSE_TOP ? reuse_by_region.count : REUSE_TOP, reuse_by_region.count);
+  append_log(buffer);
+  print_table(&reuse_by_region);
+}
+
+/*
+  This function records the reuse distances of the reads and writes of
+  a trace, and prints them
+
+    filename - the trace, in din or binary format
+    block_size_value - the block size distances are counted in
+    region_size_value - the size of the address regions
+
+  returns 0 if successful, non-zero if the trace couldn't be read
+ */
+int run_reuse(const char* filename, int block_size_value, int region_size_value)
+{
+  char buffer[200];
+  traceReader reader;
+  unsigned int access;
+
+  if(open_trace(&reader, filename) != 0)
+  {
+    sprintf(buffer, "Unable to load [%s]\n", filename);
+    append_log(buffer);
+    return -1;
+  }
+  if(start_reuse(block_size_value, region_size_value) != 0)
+  {
+    close_trace(&reader);
+    return -1;
+  }
+
+  //traces don't say which instruction made an access
+  while(reuse_active && next_access(&reader, &access))
+  {
+    if((access & 3) != 2)
+      record_reuse(access & ~3u, NO_PC);
+  }
+  close_trace(&reader);
+
+  if(!reuse_active)
+    return -1;
+  reuse_active = 0;
+  sprintf(buffer, "[%s]\n", filename);
+  append_log(buffer);
+  print_reuse();
+  return 0;
+}
@@ -6,36 +6,87 @@ char* program_name;
 CacheView view;
 int gui_active;
 
-void validate_cache_parameters(int set_count_value, int assoc_value, int block_size_value)
+/*
+  This function clamps the cache parameters to sizes that can be
+  simulated and replaces the cache with one of that size
+
+  returns 0 if successful, non-zero if there isn't memory for the new
+  cache, in which case the old one is kept as it is
+ */
+int validate_cache_parameters(int set_count_value, int assoc_value, int block_size_value)
 {
+  unsigned int new_assoc;
+  unsigned int new_set_count;
+  unsigned int new_block_size;
+  char buffer[200];
+
   if(assoc_value < 0)
-    assoc = 0;
+    new_assoc = 0;
   else if(assoc_value > MAX_ASSOC)
-    assoc = MAX_ASSOC;
+    new_assoc = MAX_ASSOC;
   else
-    assoc = assoc_value;
+    new_assoc = assoc_value;
 
   if(set_count_value < 0)
-    set_count = 0;
+    new_set_count = 0;
   else if(set_count_value > MAX_SETS)
-    set_count = MAX_SETS;
+    new_set_count = MAX_SETS;
   else if(set_count_value != 0)
-    set_count = 1 << uint_log2(set_count_value);
+    new_set_count = 1 << uint_log2(set_count_value);
   else
-    set_count = 0;
+    new_set_count = 0;
 
   if(block_size_value < 0)
-    block_size = 0;
+    new_block_size = 0;
   else if(block_size_value > MAX_BLOCK_SIZE)
-    block_size = MAX_BLOCK_SIZE;
+    new_block_size = MAX_BLOCK_SIZE;
   else if(block_size_value != 0)
   {
-    block_size = 1 << uint_log2(block_size_value);    
-    if(block_size == 1 || block_size == 2)
-      block_size = 4;
+    new_block_size = 1 << uint_log2(block_size_value);    
+    if(new_block_size == 1 || new_block_size == 2)
+      new_block_size = 4;
   } 
   else
-    block_size = 0;
+    new_block_size = 0;
+
+  /* Replace the cache with one of the new size */
+  if(allocate_cache(new_set_count, new_assoc, new_block_size) != 0)
+  {
+    sprintf(buffer, "Not enough memory for a %u x %u x %u byte cache; keeping the old one\n", new_set_count, new_assoc, new_block_size);
+    append_log(buffer);
+    return -1;
+  }
+  return 0;
+}
+
+/* How config names each replacement policy, and how it is shown */
+static char* policy_options[NUM_POLICIES] = { "r", "lru", "lfu", "plru", "bplru", "srrip", "brrip", "drrip", "dip", "opt" };
+static char* policy_names[NUM_POLICIES] = { "Random", "LRU", "LFU", "Tree PLRU", "Bit PLRU", "SRRIP", "BRRIP", "DRRIP", "DIP", "OPT" };
+
+/* Sets *p to the policy config calls option; returns 0, or -1 if there's none */
+int parse_policy(const char* option, ReplacementPolicy* p)
+{
+  int i;
+
+  for(i = 0; i < NUM_POLICIES; i++)
+  {
+    if(strcmp(option, policy_options[i]) == 0)
+    {
+      *p = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+char* policy_option(ReplacementPolicy p)
+{
+  return policy_options[p];
+}
+
+char* policy_name(ReplacementPolicy p)
+{
+  return policy_names[p];
 }
 
 int load_dumpfile(const char* filename)
@@ -100,6 +151,7 @@ int main(int argc, char** argv)
   policy = LRU;
   view = INDEX;
   memory_sync_policy = WRITE_BACK;
+  lfu_aging = 0;
 
   /* Initialize memory */
   init_memory();
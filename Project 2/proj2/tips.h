@@ -23,9 +23,9 @@ typedef unsigned int instruction;
 #define STACK_START 0x7fffeffc
 
 /* Define Cache Constants */
-#define MAX_BLOCK_SIZE 32
-#define MAX_SETS 16
-#define MAX_ASSOC 5
+#define MAX_BLOCK_SIZE 4096
+#define MAX_SETS 65536
+#define MAX_ASSOC 32
 
 /* Define Execution Constants */
 #define MIN_SPEED 10
@@ -50,7 +50,7 @@ extern char* program_name;
   Typedef some useful states for variables
 *****************************************************************************/
 
-typedef enum {RANDOM, LRU, LFU} ReplacementPolicy;
+typedef enum {RANDOM, LRU, LFU, PLRU, BIT_PLRU, SRRIP, BRRIP, DRRIP, DIP, OPT, NUM_POLICIES} ReplacementPolicy;
 typedef enum {WRITE_BACK, WRITE_THROUGH} MemorySyncPolicy;
 typedef enum {READ, WRITE} WriteEnable;
 typedef enum {BYTE_SIZE = 0, HALF_WORD_SIZE, WORD_SIZE, DOUBLEWORD_SIZE, QUADWORD_SIZE, OCTWORD_SIZE} TransferUnit;
@@ -65,37 +65,159 @@ extern unsigned int assoc;                   /* Cache associativity       */
 extern unsigned int block_size;              /* Cache block size in bytes */
 extern ReplacementPolicy policy;             /* Cache replacement policy  */
 extern MemorySyncPolicy memory_sync_policy;  /* Memory sync policy        */
+extern unsigned int lfu_aging;               /* LFU halves a set's counts after this many accesses to it; 0 never */
 
-/* Define cache block
-   ==================
-   valid - assign INVALID if block invalid; assign VALID if block valid
-   tag - container for the tag bits; unsigned to allow ignoring sign ext issue
-   data - the data contained in a block
-   lru.data - pointer to lru information
-   lru.value - int that represents lru information
+/* Splitting an address into tag, index and offset; these are set along
+   with the parameters above, so accessMemory() needn't work them out:
+     tag = addr >> tag_shift
+     index = (addr >> offset_bits) & index_mask
+     offset = addr & offset_mask
+*/
+extern unsigned int offset_bits;             /* log2(block_size)          */
+extern unsigned int tag_shift;               /* log2(set_count * block_size) */
+extern unsigned int index_mask;              /* set_count - 1             */
+extern unsigned int offset_mask;             /* block_size - 1            */
+
+/* Define cache block state
+   ========================
+   dirty - assign DIRTY once the block differs from memory
+   accessCount - number of accesses, for LFU
+   newer, older - the neighbours of the block in its set's recency list
+   lfu_bucket - for LFU, the bucket of blocks with the same accessCount
+                that holds the block
+   lfu_newer, lfu_older - the neighbours of the block in its bucket
+   rrpv - for SRRIP, BRRIP and DRRIP, how far off the block's next use is
+          predicted to be, from 0 (soon) to RRPV_MAX (not at all)
+   next_use - for OPT, the position in the trace of the block's next use
+   opt_place - for OPT, where the block is in its set's heap
 */
 typedef struct {
-  enum {INVALID, VALID} valid;   
   enum {VIRGIN, DIRTY} dirty;
-  unsigned int tag;
-  byte data[MAX_BLOCK_SIZE];
-  union { 
-    void* data;
-    unsigned int value;
-  } lru;
   int accessCount;
+  unsigned char newer;
+  unsigned char older;
+  unsigned char lfu_bucket;
+  unsigned char lfu_newer;
+  unsigned char lfu_older;
+  unsigned char rrpv;
+  unsigned long long next_use;
+  unsigned char opt_place;
 } cacheBlock;
 
-/* Define cache unit
-   =================
-   block - array that represents a set of blocks with the SAME index
+#define RRPV_MAX 3
+
+/* Define cache set state
+   ======================
+   mru, lru - the most and least recently used blocks, the ends of the
+              recency list that runs from mru through each block's older
+   plru - the tree bits for PLRU, or the recently used bits for BIT_PLRU
+   lfu_least - for LFU, the bucket with the smallest accessCount
+   lfu_free - the first unused bucket, the rest following through higher
+   lfu_accesses - accesses to the set since its counts were last halved
 */
 typedef struct {
-  cacheBlock block[MAX_ASSOC];
+  unsigned char mru;
+  unsigned char lru;
+  unsigned int plru;
+  unsigned char lfu_least;
+  unsigned char lfu_free;
+  unsigned int lfu_accesses;
 } cacheSet;
 
-/* Define actual cache structure that will be manipulated by accessMemory() */
-extern cacheSet cache[MAX_SETS];
+/* Define LFU bucket
+   =================
+   Each set has assoc buckets. Those in use hold the valid blocks with a
+   given accessCount, from the least recently used (lru) through each
+   block's lfu_newer, and are linked in order of count.
+   count - the accessCount of the blocks in the bucket
+   mru, lru - the ends of the bucket's list of blocks
+   lower, higher - the buckets with the next smaller and larger counts
+*/
+typedef struct {
+  int count;
+  unsigned char mru;
+  unsigned char lru;
+  unsigned char lower;
+  unsigned char higher;
+} lfuBucket;
+
+enum {INVALID, VALID};
+
+/* Define cache statistics
+   =======================
+   Counted by accessMemory() since the cache was last flushed.
+   accesses, misses - all accesses to the cache, and those that missed
+   writebacks - dirty blocks written back to memory when replaced
+   duel_accesses, duel_misses - for DRRIP and DIP, which set aside a few
+       leader sets for each of two policies, the accesses and misses of
+       each kind of set; DRRIP duels SRRIP against BRRIP, and DIP duels
+       LRU against BIP (LRU that inserts blocks at the LRU end)
+   psel - counts up on a miss in the first policy's leaders and down on a
+          miss in the second's; the other sets follow the second policy
+          while it is above PSEL_MAX / 2
+*/
+typedef enum {FIRST_LEADER, SECOND_LEADER, FOLLOWER, NUM_DUEL_ROLES} DuelRole;
+
+typedef struct {
+  unsigned long long accesses;
+  unsigned long long misses;
+  unsigned long long writebacks;
+  unsigned long long duel_accesses[NUM_DUEL_ROLES];
+  unsigned long long duel_misses[NUM_DUEL_ROLES];
+  unsigned int psel;
+} cacheStats;
+
+#define PSEL_MAX 1023
+
+extern cacheStats cache_stats;
+
+/* Define actual cache structure that will be manipulated by accessMemory()
+   ========================================================================
+   The cache is allocated by validate_cache_parameters() as separate arrays,
+   the blocks of a set next to one another so all of a set's tags can be
+   compared at once:
+   cache_tag - the tag bits of each block; unsigned to allow ignoring sign ext issue
+   cache_valid - for each set, bit "way" is 1 if that block is VALID
+   cache_block - the state of each block
+   cache_set - the replacement state of each set
+   cache_bucket - the LFU buckets of each set, assoc of them
+   cache_heap - for OPT, each set's blocks as a heap with the block used
+                furthest in the future first
+   cache_data - block_size bytes of data for each block
+   Use the macros below to reach the block "way" of set "set".
+   cache_tag has TAG_PADDING spare entries at the end, so a set's tags may
+   be read in whole vectors.
+*/
+extern unsigned int* cache_tag;
+extern unsigned int* cache_valid;
+extern cacheBlock* cache_block;
+extern cacheSet* cache_set;
+extern lfuBucket* cache_bucket;
+extern unsigned char* cache_heap;
+extern byte* cache_data;
+
+#define TAG_PADDING 8
+
+#define BLOCK_NUMBER(set, way) ((size_t)(set) * assoc + (way))
+#define BLOCK_TAG(set, way) (cache_tag[BLOCK_NUMBER(set, way)])
+#define BLOCK_VALID(set, way) ((cache_valid[set] >> (way)) & 1)
+#define BLOCK(set, way) (cache_block[BLOCK_NUMBER(set, way)])
+#define BLOCK_DATA(set, way) (cache_data + BLOCK_NUMBER(set, way) * block_size)
+#define BUCKET(set, i) (cache_bucket[BLOCK_NUMBER(set, i)])
+#define HEAP(set, i) (cache_heap[BLOCK_NUMBER(set, i)])
+
+/* Replaying a trace
+   =================
+   run_trace() sends each access of a trace to accessMemory(), with
+   trace_active set, so there is no memory behind the cache. Only then
+   can OPT be used: before each access, opt_next_use is set to the
+   position in the trace of the next access to the same block, or
+   NEVER_USED.
+*/
+extern int trace_active;
+extern unsigned long long opt_next_use;
+
+#define NEVER_USED (~0ULL)
 
 /*
   This function should be called when you want to interact with physical memory
@@ -111,6 +233,20 @@ extern cacheSet cache[MAX_SETS];
  */
 int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag);
 
+/*
+  This function moves a whole block between memory and the cache, using
+  as many accessDRAM() transfers as it takes
+
+    addr - a 32-bit address of the start of the block
+    data - pointer to the block's data in the cache
+    size - the number of bytes to transfer, a power of two
+    flag - states whether we want to READ from memory or WRITE to memory
+
+  returns 0 if successful, non-zero if there was a problem.
+
+ */
+int accessDRAMBlock(address addr, byte* data, unsigned int size, WriteEnable flag);
+
 
 /*
   This function is the function you will be implementing. Its purpose
@@ -173,10 +309,40 @@ void highlight_offset(unsigned int set_num, unsigned int assoc_num, unsigned int
 /* Defined in tips.c */
 int load_dumpfile(const char* filename);
 void reverse_endianness(instruction* word);
+int parse_policy(const char* option, ReplacementPolicy* p);
+char* policy_option(ReplacementPolicy p);
+char* policy_name(ReplacementPolicy p);
 
 /* Defined in memory.c */
 void init_memory(void);
 void flush_cache(void);
+void write_back_cache(void);
+int allocate_cache(unsigned int new_set_count, unsigned int new_assoc, unsigned int new_block_size);
+
+/* Defined in trace.c */
+typedef struct {
+  unsigned char* start;     /* the trace, mapped into memory */
+  unsigned char* next;      /* the next byte to read */
+  unsigned char* end;
+  unsigned char* dropped;   /* the pages before this have been let go */
+  int binary;
+} traceReader;
+
+int open_trace(traceReader* reader, const char* filename);
+int next_access(traceReader* reader, unsigned int* access);
+void close_trace(traceReader* reader);
+int run_trace(const char* filename);
+
+/* Defined in stackdist.c */
+int run_mrc(const char* filename, int block_size_value, int max_sets_value);
+
+/* While set, the program's loads and stores are given to record_reuse() */
+extern int reuse_active;
+
+int start_reuse(int block_size_value, int region_size_value);
+void record_reuse(address addr, address pc);
+void print_reuse(void);
+int run_reuse(const char* filename, int block_size_value, int region_size_value);
 
 /* Defined in cpu.c */
 void reinit_processor(void);
@@ -197,4 +363,5 @@ void init_lfu(int set_number, int assoc_value);
 void init_lru(int set_number, int assoc_value);
 char* lfu_to_string(int set_number, int assoc_value);
 char* lru_to_string(int set_number, int assoc_value);
-void validate_cache_parameters(int set_number, int assoc_value, int block_size_value);
+int validate_cache_parameters(int set_number, int assoc_value, int block_size_value);
+void print_stats(void);
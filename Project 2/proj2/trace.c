@@ -0,0 +1,403 @@
+#define _DEFAULT_SOURCE
+#include "tips.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int trace_active;
+unsigned long long opt_next_use;
+
+/*
+  Traces come in two formats:
+
+  din - Dinero's text format, a line for each access with its label (0
+        for a read, 1 for a write, 2 for an instruction fetch) and its
+        address in hex. Lines with other labels are skipped.
+
+  binary - TRACE_MAGIC, then 4 bytes for each access: its address,
+           little-endian, with the label in place of the low two bits.
+           Accesses labelled 3 are skipped.
+
+  next_access() gives accesses in the binary form, the word with the
+  label in its low bits; the cache is only ever asked for whole words.
+*/
+#define TRACE_MAGIC "TIPSTRC1"
+#define TRACE_MAGIC_SIZE 8
+
+/* Pages of the trace already read are let go this many bytes at a time */
+#define DROP_CHUNK (64 << 20)
+
+/*
+  This function maps a trace into memory to be read from the start, so
+  it needn't fit in memory all at once
+
+    reader - set up to read the trace
+    filename - the trace
+
+  returns 0 if successful, non-zero if the trace couldn't be mapped
+ */
+int open_trace(traceReader* reader, const char* filename)
+{
+  struct stat st;
+  void* mapped = NULL;
+  int fd;
+
+  if((fd = open(filename, O_RDONLY)) < 0)
+    return -1;
+  if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    close(fd);
+    return -1;
+  }
+  if(st.st_size != 0)
+  {
+    mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapped == MAP_FAILED)
+    {
+      close(fd);
+      return -1;
+    }
+    madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  reader->start = (unsigned char*)mapped;
+  reader->next = reader->start;
+  reader->end = reader->start + st.st_size;
+  reader->dropped = reader->start;
+  reader->binary = st.st_size >= TRACE_MAGIC_SIZE && memcmp(mapped, TRACE_MAGIC, TRACE_MAGIC_SIZE) == 0;
+  if(reader->binary)
+    reader->next += TRACE_MAGIC_SIZE;
+  return 0;
+}
+
+/* unmaps a trace opened by open_trace() */
+void close_trace(traceReader* reader)
+{
+  if(reader->start != NULL)
+    munmap(reader->start, reader->end - reader->start);
+}
+
+/* lets go of the whole pages of the trace that have been read */
+static void drop_behind(traceReader* reader)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  unsigned char* upto = reader->start + (reader->next - reader->start) / page * page;
+
+  madvise(reader->dropped, upto - reader->dropped, MADV_DONTNEED);
+  reader->dropped = upto;
+}
+
+/* returns the value of hex digit c, or -1 if it isn't one */
+static int hex_digit(unsigned char c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/*
+  This function reads the next line of a din trace that holds an access
+
+    reader - the trace
+    access - set to the access, in the binary form
+
+  returns 1 if there was an access, 0 at the end of the trace
+ */
+static int next_din(traceReader* reader, unsigned int* access)
+{
+  unsigned char* p = reader->next;
+  unsigned char* end = reader->end;
+  unsigned int label;
+  unsigned int addr;
+  int label_digits;
+  int addr_digits;
+  int digit;
+
+  while(p < end)
+  {
+    label = 0;
+    addr = 0;
+    label_digits = 0;
+    addr_digits = 0;
+    while(p < end && (*p == ' ' || *p == '\t'))
+      p++;
+    for(; p < end && *p >= '0' && *p <= '9'; p++, label_digits++)
+      label = 10 * label + (*p - '0');
+    while(p < end && (*p == ' ' || *p == '\t'))
+      p++;
+    if(end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+      p += 2;
+    for(; p < end && (digit = hex_digit(*p)) >= 0; p++, addr_digits++)
+      addr = (addr << 4) | digit;
+
+    //the rest of the line is ignored
+    while(p < end && *p != '\n')
+      p++;
+    if(p < end)
+      p++;
+
+    if(label_digits != 0 && addr_digits != 0 && label <= 2)
+    {
+      reader->next = p;
+      *access = (addr & ~3u) | label;
+      return 1;
+    }
+  }
+  reader->next = p;
+  return 0;
+}
+
+/*
+  This function reads the next access of a trace
+
+    reader - the trace
+    access - set to the access, in the binary form
+
+  returns 1 if there was an access, 0 at the end of the trace
+ */
+int next_access(traceReader* reader, unsigned int* access)
+{
+  unsigned char* p;
+
+  if(reader->next - reader->dropped >= DROP_CHUNK)
+    drop_behind(reader);
+
+  if(!reader->binary)
+    return next_din(reader, access);
+
+  for(p = reader->next; reader->end - p >= 4; p += 4)
+  {
+    *access = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    if((*access & 3) != 3)
+    {
+      reader->next = p + 4;
+      return 1;
+    }
+  }
+  reader->next = p;
+  return 0;
+}
+
+/* starts a trace over from its first access */
+static void rewind_trace(traceReader* reader)
+{
+  reader->next = reader->start;
+  reader->dropped = reader->start;
+  if(reader->binary)
+    reader->next += TRACE_MAGIC_SIZE;
+}
+
+/*
+  Blocks of a trace and where each was last seen, for find_next_uses().
+  seen holds one more than the place, so 0 marks an empty slot.
+*/
+typedef struct {
+  unsigned int* block;
+  unsigned long long* seen;
+  unsigned int bits;          /* there are 2^bits slots */
+  size_t used;
+} useTable;
+
+/* returns the slot of block b, or the empty slot it would go in */
+static size_t find_use(const useTable* table, unsigned int b)
+{
+  size_t slot = (b * 0x9e3779b97f4a7c15ULL) >> (64 - table->bits);
+
+  while(table->seen[slot] != 0 && table->block[slot] != b)
+    slot = (slot + 1) & (((size_t)1 << table->bits) - 1);
+  return slot;
+}
+
+/*
+  This function doubles the size of a use table, or makes its first
+  slots
+
+  returns 0 if successful, non-zero if there isn't memory for it
+ */
+static int grow_uses(useTable* table)
+{
+  unsigned int* old_block = table->block;
+  unsigned long long* old_seen = table->seen;
+  size_t old_slots = old_seen != NULL ? (size_t)1 << table->bits : 0;
+  size_t slot;
+  size_t i;
+
+  table->bits = old_seen != NULL ? table->bits + 1 : 10;
+  table->block = (unsigned int*)malloc(sizeof(unsigned int) << table->bits);
+  table->seen = (unsigned long long*)calloc((size_t)1 << table->bits, sizeof(unsigned long long));
+  if(table->block == NULL || table->seen == NULL)
+  {
+    free(table->block);
+    free(table->seen);
+    table->block = old_block;
+    table->seen = old_seen;
+    table->bits--;
+    return -1;
+  }
+
+  for(i = 0; i < old_slots; i++)
+  {
+    if(old_seen[i] != 0)
+    {
+      slot = find_use(table, old_block[i]);
+      table->block[slot] = old_block[i];
+      table->seen[slot] = old_seen[i];
+    }
+  }
+  free(old_block);
+  free(old_seen);
+  return 0;
+}
+
+/*
+  This function finds, for each access of a trace, where the same block
+  is next used, for OPT. It reads the trace forwards, keeping the last
+  place each block was seen in a hash table that grows with the number
+  of distinct blocks, and fills in that place's next use when the block
+  comes round again. Only the next uses are kept, not the accesses;
+  the trace is read again to replay it.
+
+    reader - the trace, read to its end
+    count - set to the number of accesses read
+
+  returns the next use of each access, NEVER_USED if there is none, or
+  NULL if there isn't memory for them
+ */
+static unsigned long long* find_next_uses(traceReader* reader, size_t* count)
+{
+  size_t room = 4096;
+  unsigned long long* next_use = (unsigned long long*)malloc(room * sizeof(unsigned long long));
+  unsigned long long* bigger;
+  useTable table = {NULL, NULL, 0, 0};
+  unsigned int access;
+  unsigned int b;
+  size_t slot;
+  int failed = 0;
+
+  *count = 0;
+  if(next_use == NULL || grow_uses(&table) != 0)
+  {
+    free(next_use);
+    return NULL;
+  }
+
+  while(next_access(reader, &access))
+  {
+    if(*count == room)
+    {
+      room *= 2;
+      bigger = (unsigned long long*)realloc(next_use, room * sizeof(unsigned long long));
+      if(bigger == NULL)
+      {
+        failed = 1;
+        break;
+      }
+      next_use = bigger;
+    }
+    //at most half full, so probes stay short
+    if(2 * (table.used + 1) > ((size_t)1 << table.bits) && grow_uses(&table) != 0)
+    {
+      failed = 1;
+      break;
+    }
+
+    b = access >> offset_bits;
+    slot = find_use(&table, b);
+    if(table.seen[slot] != 0)
+      next_use[table.seen[slot] - 1] = *count;
+    else
+    {
+      table.block[slot] = b;
+      table.used++;
+    }
+    table.seen[slot] = *count + 1;
+    next_use[(*count)++] = NEVER_USED;
+  }
+
+  if(failed)
+  {
+    free(next_use);
+    next_use = NULL;
+  }
+  free(table.block);
+  free(table.seen);
+  return next_use;
+}
+
+/*
+  This function replays a trace through the cache, starting from an
+  empty cache, and prints how it did. Dirty blocks of the program are
+  written back first, so none of its data is lost. The trace is read as
+  it is replayed; OPT reads it once beforehand to find the next uses.
+
+    filename - the trace, in din or binary format
+
+  returns 0 if successful, non-zero if the trace couldn't be replayed
+ */
+int run_trace(const char* filename)
+{
+  char buffer[200];
+  traceReader reader;
+  unsigned long long* next_use = NULL;
+  unsigned int access;
+  cacheStats stats;
+  size_t count = 0;
+  unsigned long long i;
+  word data = 0;
+
+  if(assoc == 0 || set_count == 0 || block_size == 0)
+  {
+    append_log("Configure a cache before replaying a trace\n");
+    return -1;
+  }
+
+  if(open_trace(&reader, filename) != 0)
+  {
+    sprintf(buffer, "Unable to load [%s]\n", filename);
+    append_log(buffer);
+    return -1;
+  }
+  if(policy == OPT)
+  {
+    next_use = find_next_uses(&reader, &count);
+    if(next_use == NULL)
+    {
+      sprintf(buffer, "Not enough memory for [%s]\n", filename);
+      append_log(buffer);
+      close_trace(&reader);
+      return -1;
+    }
+    rewind_trace(&reader);
+  }
+
+  //the program's data must reach memory before the trace takes the cache
+  write_back_cache();
+  flush_cache();
+  trace_active = 1;
+  for(i = 0; (next_use == NULL || i < count) && next_access(&reader, &access); i++)
+  {
+    if(next_use != NULL)
+      opt_next_use = next_use[i];
+    accessMemory(access & ~3u, &data, (access & 3) == 1 ? WRITE : READ);
+  }
+  trace_active = 0;
+
+  //the blocks hold none of the program's data, so none of them may stay
+  stats = cache_stats;
+  flush_cache();
+  cache_stats = stats;
+
+  sprintf(buffer, "[%s] replayed, %llu accesses\n", filename, i);
+  append_log(buffer);
+  print_stats();
+
+  free(next_use);
+  close_trace(&reader);
+  return 0;
+}